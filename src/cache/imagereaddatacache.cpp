@@ -0,0 +1,90 @@
+#include "imagereaddatacache.h"
+
+ImageReadDataCache::ImageReadDataCache(qsizetype maxCost) : _maxCost(qMax<qsizetype>(maxCost, 1))
+{
+    // 分片本身不按自己的份额淘汰, 由 evict() 按总预算淘汰
+    for (auto& shard : _shards)
+    {
+        shard.cache.setMaxCost(_maxCost);
+    }
+}
+
+ImageReadDataPtr ImageReadDataCache::find(uint64_t hash)
+{
+    Shard& shard = shardFor(hash);
+    QMutexLocker locker(&shard.mutex);
+    ImageReadDataPtr* readData = shard.cache.object(hash);
+    return nullptr == readData ? ImageReadDataPtr() : *readData;
+}
+
+void ImageReadDataCache::insert(uint64_t hash, const ImageReadDataPtr& readData, qsizetype cost)
+{
+    cost = qMax<qsizetype>(1, cost);
+    Shard& shard = shardFor(hash);
+    {
+        QMutexLocker locker(&shard.mutex);
+        const qsizetype before = shard.cache.totalCost();
+        if (cost > _maxCost)
+        {
+            // 比整个预算还大, 不缓存, 同时去掉旧的项
+            shard.cache.remove(hash);
+        }
+        else
+        {
+            shard.cache.insert(hash, new ImageReadDataPtr(readData), cost);
+        }
+        _totalCost += shard.cache.totalCost() - before;
+    }
+    evict();
+}
+
+void ImageReadDataCache::evict()
+{
+    // 每个分片内按最近使用淘汰, 分片之间轮流, 近似全局LRU
+    for (int attempts = 0; _totalCost > _maxCost && attempts < SHARD_COUNT * 2; ++attempts)
+    {
+        Shard& shard = _shards[_evictCursor.fetch_add(1) % SHARD_COUNT];
+        QMutexLocker locker(&shard.mutex);
+        const qsizetype before = shard.cache.totalCost();
+        const qsizetype excess = _totalCost - _maxCost;
+        if (before == 0 || excess <= 0)
+        {
+            continue;
+        }
+        // 调低上限时QCache从最久未用的项开始删除
+        shard.cache.setMaxCost(qMax<qsizetype>(0, before - excess));
+        shard.cache.setMaxCost(_maxCost);
+        _totalCost += shard.cache.totalCost() - before;
+    }
+}
+
+void ImageReadDataCache::remove(uint64_t hash)
+{
+    Shard& shard = shardFor(hash);
+    QMutexLocker locker(&shard.mutex);
+    const qsizetype before = shard.cache.totalCost();
+    shard.cache.remove(hash);
+    _totalCost += shard.cache.totalCost() - before;
+}
+
+void ImageReadDataCache::clear()
+{
+    for (auto& shard : _shards)
+    {
+        QMutexLocker locker(&shard.mutex);
+        const qsizetype before = shard.cache.totalCost();
+        shard.cache.clear();
+        _totalCost -= before;
+    }
+}
+
+qsizetype ImageReadDataCache::maxCost() const
+{
+    return _maxCost;
+}
+
+ImageReadDataCache::Shard& ImageReadDataCache::shardFor(uint64_t hash)
+{
+    // fasthash64 高位分布均匀
+    return _shards[(hash >> 60) % SHARD_COUNT];
+}
@@ -0,0 +1,63 @@
+#ifndef IMAGEREADDATACACHE_H
+#define IMAGEREADDATACACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include <QSharedPointer>
+
+#include <array>
+#include <atomic>
+
+struct ImageReadData;
+typedef QSharedPointer<ImageReadData> ImageReadDataPtr;
+
+//************************************
+// 线程安全的图片内存缓存
+// 按hash分片加锁(lock striping), 每个分片是一个按cost淘汰的QCache。
+// 各分片共用一个预算: 总cost超出时轮流从各分片淘汰最久未用的项,
+// 超过整个预算的对象不缓存。
+// 缓存中只保存引用计数句柄, 淘汰时只释放句柄, 外部仍持有的数据不会被删除。
+//************************************
+class ImageReadDataCache
+{
+public:
+    // maxCost 为整个缓存的预算, 各分片共用
+    explicit ImageReadDataCache(qsizetype maxCost);
+
+    ImageReadDataCache(const ImageReadDataCache&) = delete;
+    ImageReadDataCache& operator=(const ImageReadDataCache&) = delete;
+
+    ImageReadDataPtr find(uint64_t hash);
+
+    void insert(uint64_t hash, const ImageReadDataPtr& readData, qsizetype cost);
+
+    void remove(uint64_t hash);
+
+    void clear();
+
+    qsizetype maxCost() const;
+
+private:
+    static const int SHARD_COUNT = 16;
+
+    struct Shard
+    {
+        QMutex mutex;
+        QCache<uint64_t, ImageReadDataPtr> cache;
+    };
+
+    qsizetype _maxCost;
+    std::array<Shard, SHARD_COUNT> _shards;
+
+    // 各分片 totalCost 之和
+    std::atomic<qsizetype> _totalCost{ 0 };
+    // 下一个淘汰的分片
+    std::atomic<int> _evictCursor{ 0 };
+
+    Shard& shardFor(uint64_t hash);
+
+    // 总cost超出预算时从各分片淘汰, 调用时不能持有分片锁
+    void evict();
+};
+
+#endif // IMAGEREADDATACACHE_H
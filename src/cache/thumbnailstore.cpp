@@ -0,0 +1,321 @@
+#include "thumbnailstore.h"
+#include "../util/fasthash.h"
+#include "../logger/Logger.h"
+
+#include <QDir>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QDateTime>
+#include <QtEndian>
+
+#include <algorithm>
+#include <vector>
+
+// 分片文件头: magic + version
+static const quint32 STORE_MAGIC = 0x43544957; // "WITC"
+static const quint32 STORE_VERSION = 1;
+static const qint64 FILE_HEADER_SIZE = 8;
+// 记录头: key(8) + length(4)
+static const qint64 RECORD_HEADER_SIZE = 12;
+
+ThumbnailStore::ThumbnailStore(const QString& dirPath, qint64 maxBytes)
+    : _dirPath(dirPath), _shardMaxBytes(qMax<qint64>(maxBytes / SHARD_COUNT, 1024 * 1024)),
+    _lock(QDir(dirPath).filePath(QStringLiteral("store.lock"))), _readOnly(false)
+{
+    QDir().mkpath(_dirPath);
+    // 界面程序可能长时间持有锁, 只在持有进程已退出时才视为失效
+    _lock.setStaleLockTime(0);
+    if (!_lock.tryLock(0))
+    {
+        _readOnly = true;
+        LOG_WARN << "thumbnail store is locked by another process, open read-only: " << _dirPath;
+    }
+    for (int i = 0; i < SHARD_COUNT; ++i)
+    {
+        _shards[i] = std::make_unique<Shard>();
+        const QString fileName = QDir(_dirPath).filePath(QStringLiteral("shard_%1.pack").arg(i, 2, 16, QLatin1Char('0')));
+        if (!openShard(*_shards[i], fileName))
+        {
+            LOG_WARN << "open thumbnail shard failed: " << fileName;
+        }
+    }
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+    for (auto& shard : _shards)
+    {
+        QMutexLocker locker(&shard->mutex);
+        unmap(*shard);
+        shard->file.close();
+    }
+}
+
+uint64_t ThumbnailStore::key(const QFileInfo& fileInfo, const QSize& thumbnailSize)
+{
+    const QString key = QStringLiteral("%1|%2|%3|%4x%5")
+        .arg(fileInfo.absoluteFilePath())
+        .arg(fileInfo.lastModified().toMSecsSinceEpoch())
+        .arg(fileInfo.size())
+        .arg(thumbnailSize.width())
+        .arg(thumbnailSize.height());
+    return fasthash64(key.constData(), static_cast<uint64_t>(key.size()) * sizeof(QChar), 0);
+}
+
+ThumbnailStore::Shard& ThumbnailStore::shardFor(uint64_t key)
+{
+    return *_shards[(key >> 56) % SHARD_COUNT];
+}
+
+bool ThumbnailStore::find(uint64_t key, QImage& image)
+{
+    Shard& shard = shardFor(key);
+    QByteArray encoded;
+    {
+        QMutexLocker locker(&shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end())
+        {
+            return false;
+        }
+        const qint64 end = it->offset + RECORD_HEADER_SIZE + it->length;
+        if (end > shard.mapSize)
+        {
+            // 映射后又追加了记录; 重新映射后仍不够说明文件比索引短, 丢弃这条记录
+            if (!remap(shard) || end > shard.mapSize)
+            {
+                shard.index.erase(it);
+                return false;
+            }
+        }
+        it->lastAccess = ++shard.clock;
+        // 只在锁内拷贝编码后的数据, 解码在锁外进行
+        encoded = QByteArray(reinterpret_cast<const char*>(shard.map + it->offset + RECORD_HEADER_SIZE), it->length);
+    }
+    return image.loadFromData(encoded);
+}
+
+void ThumbnailStore::insert(uint64_t key, const QImage& image)
+{
+    if (image.isNull())
+    {
+        return;
+    }
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    if (image.hasAlphaChannel())
+    {
+        image.save(&buffer, "png");
+    }
+    else
+    {
+        image.save(&buffer, "jpg", 85);
+    }
+    buffer.close();
+
+    uchar header[RECORD_HEADER_SIZE];
+    qToLittleEndian<quint64>(key, header);
+    qToLittleEndian<quint32>(static_cast<quint32>(encoded.size()), header + 8);
+
+    Shard& shard = shardFor(key);
+    QMutexLocker locker(&shard.mutex);
+    if (_readOnly || !shard.file.isOpen() || shard.index.contains(key))
+    {
+        return;
+    }
+    const qint64 offset = shard.file.size();
+    if (!shard.file.seek(offset)
+        || shard.file.write(reinterpret_cast<const char*>(header), RECORD_HEADER_SIZE) != RECORD_HEADER_SIZE
+        || shard.file.write(encoded) != encoded.size()
+        || !shard.file.flush())
+    {
+        // 丢弃写了一半的记录
+        shard.file.resize(offset);
+        return;
+    }
+    shard.index.insert(key, Record{ offset, static_cast<quint32>(encoded.size()), ++shard.clock });
+    shard.bytes += RECORD_HEADER_SIZE + encoded.size();
+    if (shard.bytes > _shardMaxBytes)
+    {
+        compact(shard);
+    }
+}
+
+void ThumbnailStore::clear()
+{
+    if (_readOnly)
+    {
+        return;
+    }
+    for (auto& shard : _shards)
+    {
+        QMutexLocker locker(&shard->mutex);
+        unmap(*shard);
+        shard->index.clear();
+        shard->bytes = 0;
+        shard->file.resize(FILE_HEADER_SIZE);
+    }
+}
+
+bool ThumbnailStore::openShard(Shard& shard, const QString& fileName)
+{
+    shard.file.setFileName(fileName);
+    if (!shard.file.open(_readOnly ? QIODevice::ReadOnly : QIODevice::ReadWrite))
+    {
+        return false;
+    }
+    uchar header[FILE_HEADER_SIZE];
+    if (shard.file.size() < FILE_HEADER_SIZE
+        || shard.file.read(reinterpret_cast<char*>(header), FILE_HEADER_SIZE) != FILE_HEADER_SIZE
+        || qFromLittleEndian<quint32>(header) != STORE_MAGIC
+        || qFromLittleEndian<quint32>(header + 4) != STORE_VERSION)
+    {
+        if (_readOnly)
+        {
+            shard.file.close();
+            return false;
+        }
+        // 新文件或版本不一致, 重建
+        qToLittleEndian<quint32>(STORE_MAGIC, header);
+        qToLittleEndian<quint32>(STORE_VERSION, header + 4);
+        shard.file.resize(0);
+        shard.file.seek(0);
+        shard.file.write(reinterpret_cast<const char*>(header), FILE_HEADER_SIZE);
+        shard.file.flush();
+    }
+    loadIndex(shard);
+    return true;
+}
+
+void ThumbnailStore::loadIndex(Shard& shard)
+{
+    shard.index.clear();
+    shard.bytes = 0;
+    if (!remap(shard))
+    {
+        return;
+    }
+    // 按写入顺序编号, 重启后越早写入的越先淘汰
+    qint64 pos = FILE_HEADER_SIZE;
+    while (pos + RECORD_HEADER_SIZE <= shard.mapSize)
+    {
+        const uint64_t key = qFromLittleEndian<quint64>(shard.map + pos);
+        const quint32 length = qFromLittleEndian<quint32>(shard.map + pos + 8);
+        if (pos + RECORD_HEADER_SIZE + length > shard.mapSize)
+        {
+            break;
+        }
+        shard.index.insert(key, Record{ pos, length, ++shard.clock });
+        shard.bytes += RECORD_HEADER_SIZE + length;
+        pos += RECORD_HEADER_SIZE + length;
+    }
+    if (pos != shard.mapSize && !_readOnly)
+    {
+        // 上次退出时末尾记录不完整, 截掉
+        unmap(shard);
+        shard.file.resize(pos);
+        remap(shard);
+    }
+}
+
+bool ThumbnailStore::remap(Shard& shard)
+{
+    unmap(shard);
+    const qint64 size = shard.file.size();
+    if (size <= 0)
+    {
+        return false;
+    }
+    shard.map = shard.file.map(0, size);
+    if (nullptr == shard.map)
+    {
+        return false;
+    }
+    shard.mapSize = size;
+    return true;
+}
+
+void ThumbnailStore::unmap(Shard& shard)
+{
+    if (nullptr != shard.map)
+    {
+        shard.file.unmap(shard.map);
+        shard.map = nullptr;
+        shard.mapSize = 0;
+    }
+}
+
+void ThumbnailStore::compact(Shard& shard)
+{
+    if (!remap(shard))
+    {
+        return;
+    }
+    std::vector<std::pair<uint64_t, Record>> records;
+    records.reserve(shard.index.size());
+    for (auto it = shard.index.cbegin(); it != shard.index.cend(); ++it)
+    {
+        records.emplace_back(it.key(), it.value());
+    }
+    // 最近访问的在前, 保留到上限的3/4
+    std::sort(records.begin(), records.end(), [](const auto& l, const auto& r) {
+        return l.second.lastAccess > r.second.lastAccess;
+        });
+
+    // 写入临时文件, 全部成功后才替换原文件; 任何一步失败原分片保持不变
+    const QString fileName = shard.file.fileName();
+    QSaveFile tmp(fileName);
+    if (!tmp.open(QIODevice::WriteOnly))
+    {
+        return;
+    }
+    const qint64 keepBytes = _shardMaxBytes * 3 / 4;
+    QHash<uint64_t, Record> index;
+    qint64 bytes = 0;
+    qint64 pos = FILE_HEADER_SIZE;
+    bool written = tmp.write(reinterpret_cast<const char*>(shard.map), FILE_HEADER_SIZE) == FILE_HEADER_SIZE;
+    for (const auto& [key, record] : records)
+    {
+        const qint64 recordSize = RECORD_HEADER_SIZE + record.length;
+        if (!written || bytes + recordSize > keepBytes)
+        {
+            break;
+        }
+        if (record.offset + recordSize > shard.mapSize)
+        {
+            // 文件比索引短, 这条记录已不存在
+            continue;
+        }
+        written = tmp.write(reinterpret_cast<const char*>(shard.map + record.offset), recordSize) == recordSize;
+        index.insert(key, Record{ pos, record.length, record.lastAccess });
+        pos += recordSize;
+        bytes += recordSize;
+    }
+    if (!written)
+    {
+        // 磁盘满等, 保留原分片
+        LOG_WARN << "compact thumbnail shard write failed: " << fileName;
+        tmp.cancelWriting();
+        return;
+    }
+
+    // Windows 下不能替换打开着的文件
+    unmap(shard);
+    shard.file.close();
+    if (!tmp.commit())
+    {
+        LOG_WARN << "compact thumbnail shard failed: " << fileName;
+        openShard(shard, fileName);
+        return;
+    }
+    if (!shard.file.open(QIODevice::ReadWrite))
+    {
+        shard.index.clear();
+        shard.bytes = 0;
+        return;
+    }
+    shard.index = std::move(index);
+    shard.bytes = bytes;
+    remap(shard);
+}
@@ -0,0 +1,78 @@
+#ifndef THUMBNAILSTORE_H
+#define THUMBNAILSTORE_H
+
+#include <QString>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QImage>
+#include <QFileInfo>
+#include <QLockFile>
+
+#include <array>
+#include <memory>
+
+//************************************
+// 持久化缩略图缓存
+// 缓存目录下分为 SHARD_COUNT 个分片文件, 每个分片只追加写入, 通过内存映射读取。
+// 键为 路径+修改时间+大小+缩略图尺寸 的 fasthash64, 缩略图以 jpg/png 编码保存。
+// 总大小超过上限时按最近访问时间淘汰(LRU), 重写分片文件。
+// 同一目录只允许一个进程写入(store.lock), 其它进程以只读方式打开, 不追加也不整理。
+//************************************
+class ThumbnailStore
+{
+public:
+    explicit ThumbnailStore(const QString& dirPath, qint64 maxBytes);
+    ~ThumbnailStore();
+
+    // 其它进程持有写锁时为true
+    bool isReadOnly() const { return _readOnly; }
+
+    ThumbnailStore(const ThumbnailStore&) = delete;
+    ThumbnailStore& operator=(const ThumbnailStore&) = delete;
+
+    static uint64_t key(const QFileInfo& fileInfo, const QSize& thumbnailSize);
+
+    bool find(uint64_t key, QImage& image);
+
+    void insert(uint64_t key, const QImage& image);
+
+    // 删除所有缩略图, 只读时无效
+    void clear();
+
+private:
+    static const int SHARD_COUNT = 16;
+
+    struct Record
+    {
+        qint64 offset;
+        quint32 length;
+        quint64 lastAccess;
+    };
+
+    struct Shard
+    {
+        QMutex mutex;
+        QFile file;
+        uchar* map = nullptr;
+        qint64 mapSize = 0;
+        qint64 bytes = 0;
+        quint64 clock = 0;
+        QHash<uint64_t, Record> index;
+    };
+
+    QString _dirPath;
+    qint64 _shardMaxBytes;
+    QLockFile _lock;
+    bool _readOnly;
+    std::array<std::unique_ptr<Shard>, SHARD_COUNT> _shards;
+
+    Shard& shardFor(uint64_t key);
+    bool openShard(Shard& shard, const QString& fileName);
+    void loadIndex(Shard& shard);
+    bool remap(Shard& shard);
+    void unmap(Shard& shard);
+    void compact(Shard& shard);
+};
+
+#endif // THUMBNAILSTORE_H
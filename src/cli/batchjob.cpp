@@ -0,0 +1,261 @@
+#include "batchjob.h"
+#include "../imagecore.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QJsonDocument>
+#include <QSet>
+#include <QThread>
+
+#include <cstdio>
+
+// 每个 io 线程最多排队的文件数, 遍历超前太多时等待, 百万文件时任务不会堆积
+#define QUEUE_PER_IO_THREAD 256
+// 每个 cpu 线程最多排队的解码任务数, 超过时 io 线程等待, 进而使遍历等待
+#define QUEUE_PER_CPU_THREAD 64
+
+BatchJob::BatchJob(ImageCore* imageCore, const BatchOptions& options) : _imageCore(imageCore), _options(options)
+{
+    _ioPool.setMaxThreadCount(qMax(1, _options.ioThreads));
+    _cpuPool.setMaxThreadCount(qMax(1, _options.jobs));
+}
+
+BatchJob::~BatchJob()
+{
+    _ioPool.waitForDone();
+    _cpuPool.waitForDone();
+}
+
+int BatchJob::run()
+{
+    const QFileInfo source(_options.sourceDir);
+    if (!source.isDir())
+    {
+        printError(QStringLiteral("scan"), _options.sourceDir, QStringLiteral("source is not a directory"));
+        return 2;
+    }
+    const QDir sourceRoot(source.absoluteFilePath());
+    QString exportRoot;
+    if (!_options.exportDir.isEmpty())
+    {
+        exportRoot = QDir(_options.exportDir).absolutePath();
+        if (!_options.dryRun && !QDir().mkpath(exportRoot))
+        {
+            printError(QStringLiteral("export"), exportRoot, QStringLiteral("can not create export directory"));
+            return 2;
+        }
+    }
+
+    if (_options.thumbnails && !_options.dryRun && _imageCore->thumbnailStoreReadOnly())
+    {
+        // 缩略图缓存同一时间只允许一个进程写入
+        printError(QStringLiteral("thumbnail"), _options.sourceDir, QStringLiteral("thumbnail cache is in use by another process"));
+        return 2;
+    }
+
+    _timer.start();
+    _progressTimer.start();
+    const qint64 queueLimit = qint64(_ioPool.maxThreadCount()) * QUEUE_PER_IO_THREAD;
+    QSet<QString> createdDirs;
+
+    QDirIterator it(sourceRoot.absolutePath(), QDir::Files | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+        QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        it.next();
+        const QFileInfo fileInfo = it.fileInfo();
+        // 导出目录在源目录内时, 不再处理导出的文件
+        if (!exportRoot.isEmpty() && fileInfo.absoluteFilePath().startsWith(exportRoot + QLatin1Char('/')))
+        {
+            continue;
+        }
+        ++_scanned;
+
+        QString targetDir;
+        if (!exportRoot.isEmpty())
+        {
+            targetDir = QDir::cleanPath(exportRoot + QLatin1Char('/') + sourceRoot.relativeFilePath(fileInfo.absolutePath()));
+            if (!_options.dryRun && !createdDirs.contains(targetDir))
+            {
+                QDir().mkpath(targetDir);
+                createdDirs.insert(targetDir);
+            }
+        }
+
+        ++_queued;
+        _ioPool.start([this, fileInfo, targetDir]() {
+            processFile(fileInfo, targetDir);
+            --_queued;
+            });
+
+        while (_queued > queueLimit)
+        {
+            QThread::msleep(5);
+            if (_progressTimer.elapsed() >= _options.progressInterval)
+            {
+                printProgress(true);
+            }
+        }
+        if (_progressTimer.elapsed() >= _options.progressInterval)
+        {
+            printProgress(true);
+        }
+    }
+
+    // io 任务会继续提交解码任务, 先等 io 线程池
+    while (!_ioPool.waitForDone(_options.progressInterval))
+    {
+        printProgress(false);
+    }
+    while (!_cpuPool.waitForDone(_options.progressInterval))
+    {
+        printProgress(false);
+    }
+    printSummary();
+    return (_exportFailed > 0 || _thumbnailFailed > 0) ? 1 : 0;
+}
+
+void BatchJob::processFile(const QFileInfo& fileInfo, const QString& targetDir)
+{
+    bool handled = false;
+    const bool isWeChatImage = _imageCore->isWeChatImage(fileInfo);
+
+    if (!targetDir.isEmpty() && isWeChatImage)
+    {
+        handled = true;
+        if (_options.dryRun)
+        {
+            // 与 exportWeChatImage 相同的命名: 文件名(不含后缀) + 识别出的格式
+            ImageProbeData probe;
+            const QString format = _imageCore->probeImage(fileInfo, probe) ? probe.format : fileInfo.suffix();
+            QJsonObject plan;
+            plan.insert(QStringLiteral("event"), QStringLiteral("plan"));
+            plan.insert(QStringLiteral("action"), QStringLiteral("export"));
+            plan.insert(QStringLiteral("source"), fileInfo.absoluteFilePath());
+            plan.insert(QStringLiteral("target"), targetDir + QLatin1Char('/') + fileInfo.baseName() + QLatin1Char('.') + format);
+            printJson(plan);
+            ++_exported;
+            _exportBytes += fileInfo.size();
+        }
+        else
+        {
+            const int ret = _imageCore->exportWeChatImage(fileInfo, targetDir);
+            if (0 == ret)
+            {
+                ++_exported;
+                _exportBytes += fileInfo.size();
+            }
+            else
+            {
+                ++_exportFailed;
+                printError(QStringLiteral("export"), fileInfo.absoluteFilePath(),
+                    1 == ret ? QStringLiteral("not a wechat image") : QStringLiteral("write failed"));
+            }
+        }
+    }
+
+    if (_options.thumbnails && (isWeChatImage || _imageCore->isImageFile(fileInfo)))
+    {
+        handled = true;
+        if (_options.dryRun)
+        {
+            QJsonObject plan;
+            plan.insert(QStringLiteral("event"), QStringLiteral("plan"));
+            plan.insert(QStringLiteral("action"), QStringLiteral("thumbnail"));
+            plan.insert(QStringLiteral("source"), fileInfo.absoluteFilePath());
+            printJson(plan);
+            ++_thumbnails;
+        }
+        else
+        {
+            const qint64 cpuQueueLimit = qint64(_cpuPool.maxThreadCount()) * QUEUE_PER_CPU_THREAD;
+            while (_cpuQueued >= cpuQueueLimit)
+            {
+                QThread::msleep(5);
+            }
+            ++_cpuQueued;
+            _cpuPool.start([this, fileInfo]() {
+                warmThumbnails(fileInfo);
+                --_cpuQueued;
+                });
+        }
+    }
+
+    if (!handled)
+    {
+        ++_skipped;
+    }
+}
+
+void BatchJob::warmThumbnails(const QFileInfo& fileInfo)
+{
+    // 从最大一档开始读取, 较小的档位由已缓存的大档缩小得到, 只解码一次; 已缓存的档位不再解码
+    for (int tier = THUMBNAIL_TIER_COUNT - 1; tier >= 0; --tier)
+    {
+        ImageReadDataPtr readData = _imageCore->readFile(fileInfo.absoluteFilePath(), ImageCore::thumbnailTierSize(tier));
+        if (readData.isNull() || readData->pixmap.isNull())
+        {
+            ++_thumbnailFailed;
+            printError(QStringLiteral("thumbnail"), fileInfo.absoluteFilePath(), QStringLiteral("decode failed"));
+            return;
+        }
+    }
+    ++_thumbnails;
+}
+
+void BatchJob::printProgress(bool scanning)
+{
+    _progressTimer.restart();
+    QJsonObject progress;
+    progress.insert(QStringLiteral("event"), QStringLiteral("progress"));
+    progress.insert(QStringLiteral("scanning"), scanning);
+    progress.insert(QStringLiteral("scanned"), qint64(_scanned));
+    progress.insert(QStringLiteral("exported"), qint64(_exported));
+    progress.insert(QStringLiteral("exportFailed"), qint64(_exportFailed));
+    progress.insert(QStringLiteral("thumbnails"), qint64(_thumbnails));
+    progress.insert(QStringLiteral("thumbnailFailed"), qint64(_thumbnailFailed));
+    progress.insert(QStringLiteral("skipped"), qint64(_skipped));
+    progress.insert(QStringLiteral("elapsedMs"), _timer.elapsed());
+    printJson(progress);
+}
+
+void BatchJob::printSummary()
+{
+    const qint64 elapsed = qMax<qint64>(1, _timer.elapsed());
+    const double seconds = elapsed / 1000.0;
+    QJsonObject summary;
+    summary.insert(QStringLiteral("event"), QStringLiteral("summary"));
+    summary.insert(QStringLiteral("dryRun"), _options.dryRun);
+    summary.insert(QStringLiteral("jobs"), _cpuPool.maxThreadCount());
+    summary.insert(QStringLiteral("ioThreads"), _ioPool.maxThreadCount());
+    summary.insert(QStringLiteral("scanned"), qint64(_scanned));
+    summary.insert(QStringLiteral("exported"), qint64(_exported));
+    summary.insert(QStringLiteral("exportFailed"), qint64(_exportFailed));
+    summary.insert(QStringLiteral("exportBytes"), qint64(_exportBytes));
+    summary.insert(QStringLiteral("thumbnails"), qint64(_thumbnails));
+    summary.insert(QStringLiteral("thumbnailFailed"), qint64(_thumbnailFailed));
+    summary.insert(QStringLiteral("skipped"), qint64(_skipped));
+    summary.insert(QStringLiteral("elapsedMs"), elapsed);
+    summary.insert(QStringLiteral("filesPerSecond"), (_exported + _thumbnails) / seconds);
+    summary.insert(QStringLiteral("exportMBPerSecond"), _exportBytes / (1024.0 * 1024.0) / seconds);
+    printJson(summary);
+}
+
+void BatchJob::printJson(const QJsonObject& object)
+{
+    const QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    QMutexLocker locker(&_outputMutex);
+    fwrite(line.constData(), 1, size_t(line.size()), stdout);
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+void BatchJob::printError(const QString& stage, const QString& file, const QString& message)
+{
+    QJsonObject error;
+    error.insert(QStringLiteral("event"), QStringLiteral("error"));
+    error.insert(QStringLiteral("stage"), stage);
+    error.insert(QStringLiteral("file"), file);
+    error.insert(QStringLiteral("message"), message);
+    printJson(error);
+}
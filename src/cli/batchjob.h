@@ -0,0 +1,86 @@
+#ifndef BATCHJOB_H
+#define BATCHJOB_H
+
+#include <QString>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QJsonObject>
+
+#include <atomic>
+
+class ImageCore;
+
+struct BatchOptions
+{
+    // 递归处理的源目录
+    QString sourceDir;
+    // 微信图片导出目录, 按源目录的子目录结构存放; 为空时不导出
+    QString exportDir;
+    // 生成各档缩略图到持久化缓存
+    bool thumbnails = false;
+    // 只输出计划, 不读写图片
+    bool dryRun = false;
+    // 解码缩略图的线程数
+    int jobs = 1;
+    // 判断类型和导出的线程数
+    int ioThreads = 4;
+    // 进度输出间隔(ms)
+    int progressInterval = 1000;
+};
+
+//************************************
+// 无界面的批量任务: 递归导出微信图片, 预先生成缩略图缓存
+// 标准输出每行一个 JSON 对象(progress / plan / error / summary), 供脚本解析
+// 主线程遍历目录, io 线程池判断类型并导出, cpu 线程池解码缩略图
+//************************************
+class BatchJob
+{
+public:
+    BatchJob(ImageCore* imageCore, const BatchOptions& options);
+    ~BatchJob();
+
+    // 返回进程退出码: 0 全部成功, 1 有文件失败, 2 参数或目录错误
+    int run();
+
+private:
+    ImageCore* _imageCore;
+    BatchOptions _options;
+
+    QThreadPool _ioPool;
+    QThreadPool _cpuPool;
+
+    QElapsedTimer _timer;
+    QElapsedTimer _progressTimer;
+
+    // 多个线程同时输出时保证每行完整
+    QMutex _outputMutex;
+
+    std::atomic<qint64> _scanned{ 0 };
+    std::atomic<qint64> _queued{ 0 };
+    // cpu 线程池中排队和执行中的解码任务数
+    std::atomic<qint64> _cpuQueued{ 0 };
+    std::atomic<qint64> _exported{ 0 };
+    std::atomic<qint64> _exportFailed{ 0 };
+    std::atomic<qint64> _exportBytes{ 0 };
+    std::atomic<qint64> _thumbnails{ 0 };
+    std::atomic<qint64> _thumbnailFailed{ 0 };
+    std::atomic<qint64> _skipped{ 0 };
+
+    // 在 io 线程中执行
+    void processFile(const QFileInfo& fileInfo, const QString& targetDir);
+
+    // 在 cpu 线程中执行
+    void warmThumbnails(const QFileInfo& fileInfo);
+
+    void printProgress(bool scanning);
+
+    void printSummary();
+
+    void printJson(const QJsonObject& object);
+
+    void printError(const QString& stage, const QString& file, const QString& message);
+};
+
+#endif // BATCHJOB_H
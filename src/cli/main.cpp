@@ -0,0 +1,89 @@
+#include "batchjob.h"
+#include "../imagecore.h"
+#include "../config.h"
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QThread>
+
+#include <cstdio>
+
+static bool gVerbose = false;
+
+// 标准输出留给 JSON, 日志写到标准错误; 默认只输出警告以上
+static void outputMessage(QtMsgType type, const QMessageLogContext& context, const QString& msg)
+{
+    if (!gVerbose && (QtDebugMsg == type || QtInfoMsg == type))
+    {
+        return;
+    }
+    const QByteArray line = qFormatLogMessage(type, context, msg).toLocal8Bit();
+    fprintf(stderr, "%s\n", line.constData());
+}
+
+int main(int argc, char* argv[])
+{
+    // 无显示的服务器上使用 offscreen 平台, 它支持在工作线程中使用 QPixmap
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    QGuiApplication::setApplicationName(QStringLiteral("weimages-cli"));
+    QGuiApplication::setApplicationVersion(QStringLiteral(WEIMAGES_VERSION));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Export WeChat .dat images and pre-generate WeImages thumbnails."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument(QStringLiteral("source"), QStringLiteral("Directory to process recursively."));
+    QCommandLineOption exportOption({ QStringLiteral("o"), QStringLiteral("export") },
+        QStringLiteral("Export WeChat images into <dir>, keeping the sub directory layout."), QStringLiteral("dir"));
+    QCommandLineOption thumbnailOption({ QStringLiteral("t"), QStringLiteral("thumbnails") },
+        QStringLiteral("Generate every thumbnail size into the persistent thumbnail cache."));
+    QCommandLineOption jobsOption({ QStringLiteral("j"), QStringLiteral("jobs") },
+        QStringLiteral("Thumbnail decode threads (default: ideal thread count)."), QStringLiteral("n"),
+        QString::number(QThread::idealThreadCount()));
+    QCommandLineOption ioThreadsOption(QStringLiteral("io-threads"),
+        QStringLiteral("Threads that classify and export files (default: 4)."), QStringLiteral("n"), QStringLiteral("4"));
+    QCommandLineOption dryRunOption(QStringLiteral("dry-run"),
+        QStringLiteral("Print what would be done without reading pixels or writing files."));
+    QCommandLineOption configOption(QStringLiteral("config"),
+        QStringLiteral("WeImages.ini to use; the thumbnail cache lives next to it."), QStringLiteral("file"));
+    QCommandLineOption intervalOption(QStringLiteral("progress-interval"),
+        QStringLiteral("Milliseconds between progress lines (default: 1000)."), QStringLiteral("ms"), QStringLiteral("1000"));
+    QCommandLineOption verboseOption({ QStringLiteral("v"), QStringLiteral("verbose") },
+        QStringLiteral("Write debug logs to stderr."));
+    parser.addOptions({ exportOption, thumbnailOption, jobsOption, ioThreadsOption, dryRunOption, configOption,
+        intervalOption, verboseOption });
+    parser.process(app);
+
+    gVerbose = parser.isSet(verboseOption);
+    qInstallMessageHandler(outputMessage);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 1 || (!parser.isSet(exportOption) && !parser.isSet(thumbnailOption)))
+    {
+        fprintf(stderr, "%s\n", qPrintable(parser.helpText()));
+        return 2;
+    }
+
+    BatchOptions options;
+    options.sourceDir = positional.first();
+    options.exportDir = parser.value(exportOption);
+    options.thumbnails = parser.isSet(thumbnailOption);
+    options.dryRun = parser.isSet(dryRunOption);
+    options.jobs = qMax(1, parser.value(jobsOption).toInt());
+    options.ioThreads = qMax(1, parser.value(ioThreadsOption).toInt());
+    options.progressInterval = qMax(10, parser.value(intervalOption).toInt());
+
+    // 必须在 ImageCore 读取配置之前
+    if (parser.isSet(configOption))
+    {
+        ConfigIni::getInstance().setPathFile(parser.value(configOption));
+    }
+
+    ImageCore imageCore;
+    BatchJob job(&imageCore, options);
+    return job.run();
+}
@@ -0,0 +1,191 @@
+#include "tiledimagewidget.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+
+#include <cmath>
+
+// 缩小图与分块在同一个缓存中, 用最高位区分
+static const quint64 LEVEL_KEY = quint64(1) << 63;
+
+static qsizetype pixmapCost(const QPixmap& pixmap)
+{
+    const qint64 bytes = qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+    return static_cast<qsizetype>(qMax<qint64>(bytes / 1024, 1));
+}
+
+TiledImageWidget::TiledImageWidget(QWidget* parent) : QWidget(parent), _scale(1.0)
+{
+    // 默认 128 MiB, cost 单位 KiB
+    _tiles.setMaxCost(128 * 1024);
+    setAttribute(Qt::WA_OpaquePaintEvent, false);
+}
+
+void TiledImageWidget::setPixmap(const QPixmap& pixmap)
+{
+    _source = pixmap;
+    _tiles.clear();
+    resize(sizeHint());
+    update();
+}
+
+void TiledImageWidget::setScale(double scale)
+{
+    _scale = qMax(scale, 0.001);
+    resize(sizeHint());
+    update();
+}
+
+double TiledImageWidget::scale() const
+{
+    return _scale;
+}
+
+QSize TiledImageWidget::imageSize() const
+{
+    return _source.size();
+}
+
+void TiledImageWidget::setTileCacheLimit(qint64 bytes)
+{
+    _tiles.setMaxCost(static_cast<qsizetype>(qMax<qint64>(bytes / 1024, 1)));
+}
+
+QSize TiledImageWidget::sizeHint() const
+{
+    if (_source.isNull())
+    {
+        return QSize(0, 0);
+    }
+    return QSize(qMax(1, int(std::floor(_source.width() * _scale))), qMax(1, int(std::floor(_source.height() * _scale))));
+}
+
+int TiledImageWidget::levelForScale(double scale) const
+{
+    // 选分辨率不低于显示的最小一级, 即 1/2^L >= scale
+    int index = 0;
+    while (scale <= 0.5 / (1 << index) && (_source.width() >> (index + 1)) > 0 && (_source.height() >> (index + 1)) > 0)
+    {
+        ++index;
+    }
+    return index;
+}
+
+QSize TiledImageWidget::levelSize(int index) const
+{
+    return QSize(qMax(1, _source.width() >> index), qMax(1, _source.height() >> index));
+}
+
+qsizetype TiledImageWidget::levelCost(int index) const
+{
+    const QSize size = levelSize(index);
+    return static_cast<qsizetype>(qint64(size.width()) * size.height() * _source.depth() / 8 / 1024);
+}
+
+const QPixmap* TiledImageWidget::level(int index)
+{
+    const quint64 key = LEVEL_KEY | quint64(index);
+    QPixmap* pixmap = _tiles.object(key);
+    if (nullptr != pixmap)
+    {
+        return pixmap;
+    }
+    // 放不下的级不生成, 避免缩放后马上被丢弃
+    if (levelCost(index) > _tiles.maxCost())
+    {
+        return nullptr;
+    }
+    // 从已缓存的最近一级(没有时为原图)开始逐级缩小一半, 只有第1级读取原图的全部像素
+    int base = index - 1;
+    QPixmap current = _source;
+    for (; base > 0; --base)
+    {
+        if (QPixmap* cached = _tiles.object(LEVEL_KEY | quint64(base)))
+        {
+            current = *cached;
+            break;
+        }
+    }
+    for (int i = base + 1; i <= index; ++i)
+    {
+        current = current.scaled(levelSize(i), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        // 中间级也放入缓存, 放不下的只用于生成下一级
+        if (levelCost(i) <= _tiles.maxCost())
+        {
+            _tiles.insert(LEVEL_KEY | quint64(i), new QPixmap(current), pixmapCost(current));
+        }
+    }
+    return _tiles.object(key);
+}
+
+QPixmap* TiledImageWidget::tile(int levelIndex, int tx, int ty)
+{
+    const quint64 key = (quint64(levelIndex) << 48) | (quint64(ty) << 24) | quint64(tx);
+    QPixmap* pixmap = _tiles.object(key);
+    if (nullptr != pixmap)
+    {
+        return pixmap;
+    }
+    const QRect rect = QRect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE).intersected(QRect(QPoint(0, 0), levelSize(levelIndex)));
+    if (rect.isEmpty())
+    {
+        return nullptr;
+    }
+    if (0 == levelIndex)
+    {
+        pixmap = new QPixmap(_source.copy(rect));
+    }
+    else if (const QPixmap* image = level(levelIndex))
+    {
+        pixmap = new QPixmap(image->copy(rect));
+    }
+    else
+    {
+        // 该级放不下, 从原图对应区域缩小出这一块
+        const QRect sourceRect(rect.x() << levelIndex, rect.y() << levelIndex, rect.width() << levelIndex, rect.height() << levelIndex);
+        pixmap = new QPixmap(_source.copy(sourceRect.intersected(_source.rect()))
+            .scaled(rect.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
+    _tiles.insert(key, pixmap, pixmapCost(*pixmap));
+    // 超过上限时 insert 会直接删除, 重新取一次
+    return _tiles.object(key);
+}
+
+void TiledImageWidget::paintEvent(QPaintEvent* event)
+{
+    if (_source.isNull())
+    {
+        return;
+    }
+    QPainter painter(this);
+    const int levelIndex = levelForScale(_scale);
+    const QSize image = levelSize(levelIndex);
+    // 该级1个像素对应的显示像素数, 宽高取整不同, 两个方向分别计算
+    const double factorX = _scale * _source.width() / image.width();
+    const double factorY = _scale * _source.height() / image.height();
+    if (std::abs(factorX - 1.0) > 1e-6 || std::abs(factorY - 1.0) > 1e-6)
+    {
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    }
+
+    const double spanX = TILE_SIZE * factorX;
+    const double spanY = TILE_SIZE * factorY;
+    const QRect exposed = event->rect();
+    const int tx0 = qMax(0, int(exposed.left() / spanX));
+    const int ty0 = qMax(0, int(exposed.top() / spanY));
+    const int tx1 = qMin((image.width() - 1) / TILE_SIZE, int(exposed.right() / spanX));
+    const int ty1 = qMin((image.height() - 1) / TILE_SIZE, int(exposed.bottom() / spanY));
+    for (int ty = ty0; ty <= ty1; ++ty)
+    {
+        for (int tx = tx0; tx <= tx1; ++tx)
+        {
+            QPixmap* pixmap = tile(levelIndex, tx, ty);
+            if (nullptr == pixmap)
+            {
+                continue;
+            }
+            const QRectF target(tx * spanX, ty * spanY, pixmap->width() * factorX, pixmap->height() * factorY);
+            painter.drawPixmap(target, *pixmap, QRectF(pixmap->rect()));
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef TILEDIMAGEWIDGET_H
+#define TILEDIMAGEWIDGET_H
+
+#include <QWidget>
+#include <QPixmap>
+#include <QCache>
+
+//************************************
+// 分块多分辨率图片显示控件, 放在 QScrollArea 中代替 QLabel
+// 控件大小 = 图片大小 * 缩放比, 绘制时只生成可见区域的 256x256 分块:
+// 第L级为原图的 1/2^L, 选不低于显示分辨率的最小一级
+// 原图与调用者共享(QPixmap 隐式共享), 不另存副本; 各级缩小图和分块共用一个内存上限,
+// 超出时按最近使用淘汰, 某一级放不下时直接从原图生成该级的分块
+//************************************
+class TiledImageWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TiledImageWidget(QWidget* parent = nullptr);
+
+    void setPixmap(const QPixmap& pixmap);
+
+    void setScale(double scale);
+
+    double scale() const;
+
+    QSize imageSize() const;
+
+    // 分块和各级缩小图的内存上限, 单位字节
+    void setTileCacheLimit(qint64 bytes);
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    static const int TILE_SIZE = 256;
+
+    QPixmap _source;
+    // 分块 key: 级 << 48 | ty << 24 | tx; 第L级缩小图 key: LEVEL_KEY | L, cost 单位 KiB
+    QCache<quint64, QPixmap> _tiles;
+    double _scale;
+
+    int levelForScale(double scale) const;
+    QSize levelSize(int index) const;
+    // 第index级缩小图占用的KiB
+    qsizetype levelCost(int index) const;
+    // 第index级缩小图, 超出内存上限放不下时返回nullptr
+    const QPixmap* level(int index);
+    QPixmap* tile(int levelIndex, int tx, int ty);
+};
+
+#endif // TILEDIMAGEWIDGET_H
@@ -5,6 +5,7 @@
 #include "config.h"
 
 #include <QSettings>
+#include <QFileInfo>
 
 ConfigIni::ConfigIni() : pathFile("WeImages.ini"), settings(new QSettings(pathFile, QSettings::IniFormat)) {
 //    Qt5
@@ -35,13 +36,18 @@ void ConfigIni::setPathFile(const QString &path_file) {
         this->pathFile = path_file;
         // 及时同步之前的
         settings->sync();
-        // 改变路径
-        QSettings::setPath(settings->format(), settings->scope(), path_file);
+        // 改变路径, QSettings::setPath 不影响已打开的对象, 需重新打开
+        delete settings;
+        settings = new QSettings(pathFile, QSettings::IniFormat);
 //        Qt5
 //        settings->setIniCodec("UTF-8");
     }
 }
 
+QString ConfigIni::iniDir() const {
+    return QFileInfo(this->pathFile).absolutePath();
+}
+
 void ConfigIni::iniWrite(const QString &key, const QVariant &value) {
     settings->setValue(key, value);
 }
@@ -34,6 +34,9 @@ public:
     // 重设config.ini文件路径
     void setPathFile(const QString &path_file);
 
+    // config.ini所在目录
+    QString iniDir() const;
+
     // 检测配置存在
     bool iniContains(const QString &key);
 
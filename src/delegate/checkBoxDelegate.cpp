@@ -1,6 +1,5 @@
 #include "checkBoxDelegate.h"
 #include "..\filelistmodel\filelistmodel.h"
-#include "..\delegate\thumbnailData.h"
 
 #include <QRadioButton>
 #include <QApplication>
@@ -49,13 +48,7 @@ void CheckBoxDelegate::paint(QPainter* painter, const QStyleOptionViewItem& opti
 
 bool CheckBoxDelegate::editorEvent(QEvent* event, QAbstractItemModel* model, const QStyleOptionViewItem& option, const QModelIndex& index)
 {
-    QVariant variant = index.data(Qt::UserRole + 3);
-    if (variant.isNull())
-    {
-        return false;
-    }
-    ThumbnailData data = variant.value<ThumbnailData>();
-    if (!data.isWeChatImage)
+    if (!index.data(IsWeChatImageRole).toBool())
     {
         return false;
     }
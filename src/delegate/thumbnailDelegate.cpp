@@ -9,13 +9,14 @@
 #include <QApplication>
 #include <QFileSystemModel>
 #include <QFileInfo>
+#include <QDateTime>
 #include <QFileIconProvider>
 #include <QRadioButton>
 #include <QGraphicsColorizeEffect>
 //#include <QtConcurrent/QtConcurrentRun>
 
-#include "thumbnailData.h"
 #include "../filelistmodel/filefilterproxymodel.h"
+#include "../filelistmodel/filelistmodel.h"
 #include "../config.h"
 #include "../imagecore.h"
 #include "../filesystemhelperfunctions.h"
@@ -23,14 +24,31 @@
 
 
 ThumbnailDelegate::ThumbnailDelegate(ImageCore* imageCore, QObject* parent) :
-    QStyledItemDelegate(parent), _imageCore(imageCore)
+    QStyledItemDelegate(parent), _imageCore(imageCore), _thumbnailSize(THUMBNAIL_WIDE, THUMBNAIL_HEIGHT),
+    _font("Fixedsys", 12), _fontMetrics(_font)
 {
+    // 合成瓦片缓存, 单位KiB
+    const int tileCacheMB = ConfigIni::getInstance().iniRead(QStringLiteral("FileList/tileCacheMB"), 32).toInt();
+    _tiles.setMaxCost(qMax(tileCacheMB, 1) * 1024);
+    _texts.setMaxCost(8192);
 }
 
 ThumbnailDelegate::~ThumbnailDelegate()
 {
 }
 
+void ThumbnailDelegate::setThumbnailSize(const QSize& size)
+{
+    if (size == _thumbnailSize || size.isEmpty())
+    {
+        return;
+    }
+    _thumbnailSize = size;
+    // 瓦片尺寸和名字省略宽度都变了
+    _tiles.clear();
+    _texts.clear();
+}
+
 void ThumbnailDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const
 {
     //LOG_INFO << " paint QModelIndex: " << index;
@@ -39,109 +57,176 @@ void ThumbnailDelegate::paint(QPainter* painter, const QStyleOptionViewItem& opt
         return;
     }
 
-    QVariant variant = index.data(Qt::UserRole + 3);
-    if (variant.isNull())
+    // 命中缓存时只读三个整数角色, 画一张合成好的图
+    const quint64 rowKey = index.data(RowKeyRole).toULongLong();
+    const qint64 thumbnailKey = index.data(ThumbnailKeyRole).toLongLong();
+    const bool checked = qvariant_cast<int>(index.data(Qt::CheckStateRole)) == Qt::CheckState::Checked;
+    const bool hover = option.state.testFlag(QStyle::State_MouseOver);
+    const qreal dpr = painter->device()->devicePixelRatioF();
+    const quint64 key = (rowKey << 2) | (checked ? 2 : 0) | (hover ? 1 : 0);
+
+    QPixmap tile;
+    ThumbnailTile* cached = _tiles.object(key);
+    if (nullptr != cached && cached->thumbnailKey == thumbnailKey
+        && cached->pixmap.size() == option.rect.size() * dpr)
     {
-        return;
+        tile = cached->pixmap;
+    }
+    else
+    {
+        tile = renderTile(option, index, rowKey, checked, hover, dpr);
+        const int cost = qMax(1, int(qint64(tile.width()) * tile.height() * 4 / 1024));
+        _tiles.insert(key, new ThumbnailTile{ tile, thumbnailKey }, cost);
     }
-    ThumbnailData data = variant.value<ThumbnailData>();
-
-    painter->save();
-
-    QRectF rect;
-    rect.setX(option.rect.x());
-    rect.setY(option.rect.y());
-    rect.setWidth(option.rect.width() - 1);
-    rect.setHeight(option.rect.height() - 1);
-
-    //QPainterPath画圆角矩形
-    const qreal radius = 2;
-    QPainterPath path;
-    path.moveTo(rect.topRight() - QPointF(radius, 0));
-    path.lineTo(rect.topLeft() + QPointF(radius, 0));
-    path.quadTo(rect.topLeft(), rect.topLeft() + QPointF(0, radius));
-    path.lineTo(rect.bottomLeft() + QPointF(0, -radius));
-    path.quadTo(rect.bottomLeft(), rect.bottomLeft() + QPointF(radius, 0));
-    path.lineTo(rect.bottomRight() - QPointF(radius, 0));
-    path.quadTo(rect.bottomRight(), rect.bottomRight() + QPointF(0, -radius));
-    path.lineTo(rect.topRight() + QPointF(0, radius));
-    path.quadTo(rect.topRight(), rect.topRight() + QPointF(-radius, -0));
-
-    bool isImageFile = false;
+    painter->drawPixmap(option.rect.topLeft(), tile);
+}
+
+const ThumbnailDelegate::ThumbnailText& ThumbnailDelegate::displayText(const QModelIndex& index, quint64 rowKey) const
+{
+    ThumbnailText* text = _texts.object(rowKey);
+    if (nullptr == text)
+    {
+        text = new ThumbnailText;
+        text->name = _fontMetrics.elidedText(index.data(FileNameRole).toString(), Qt::ElideRight, _thumbnailSize.width() - 4);
+        text->size = fileSizeToString(index.data(FileSizeRole).toLongLong());
+        text->date = QDateTime::fromMSecsSinceEpoch(index.data(LastModifiedRole).toLongLong()).toString("yyyy-MM-dd");
+        _texts.insert(rowKey, text);
+    }
+    return *text;
+}
+
+const QPainterPath& ThumbnailDelegate::framePath(const QSize& size) const
+{
+    if (size != _frameSize)
     {
-        if (!data.fileInfo.isFile() || (isImageFile = this->_imageCore->isImageFile(data.fileInfo)))
+        _frameSize = size;
+        const QRectF rect(0, 0, size.width() - 1, size.height() - 1);
+
+        //QPainterPath画圆角矩形
+        const qreal radius = 2;
+        QPainterPath path;
+        path.moveTo(rect.topRight() - QPointF(radius, 0));
+        path.lineTo(rect.topLeft() + QPointF(radius, 0));
+        path.quadTo(rect.topLeft(), rect.topLeft() + QPointF(0, radius));
+        path.lineTo(rect.bottomLeft() + QPointF(0, -radius));
+        path.quadTo(rect.bottomLeft(), rect.bottomLeft() + QPointF(radius, 0));
+        path.lineTo(rect.bottomRight() - QPointF(radius, 0));
+        path.quadTo(rect.bottomRight(), rect.bottomRight() + QPointF(0, -radius));
+        path.lineTo(rect.topRight() + QPointF(0, radius));
+        path.quadTo(rect.topRight(), rect.topRight() + QPointF(-radius, -0));
+        _framePath = path;
+    }
+    return _framePath;
+}
+
+QPixmap ThumbnailDelegate::renderTile(const QStyleOptionViewItem& option, const QModelIndex& index,
+    quint64 rowKey, bool checked, bool hover, qreal dpr) const
+{
+    QPixmap tile(option.rect.size() * dpr);
+    tile.setDevicePixelRatio(dpr);
+    tile.fill(Qt::transparent);
+    QPainter painter(&tile);
+
+    const QPixmap thumbnail = index.data(ThumbnailRole).value<QPixmap>();
+    const bool isFile = index.data(IsFileRole).toBool();
+    const bool isImageFile = index.data(IsImageRole).toBool();
+    const bool isWeChatImage = index.data(IsWeChatImageRole).toBool();
+
+    // 瓦片内的局部坐标
+    const QRectF rect(0, 0, option.rect.width() - 1, option.rect.height() - 1);
+    const QPainterPath& path = framePath(option.rect.size());
+
+    {
+        if (!isFile || isImageFile)
         {
-            if (option.state.testFlag(QStyle::State_MouseOver))
+            if (hover)
             {
-                painter->setPen(QPen(Qt::green));
+                painter.setPen(QPen(Qt::green));
             }
             else {
-                painter->setPen(QPen(Qt::black));
+                painter.setPen(QPen(Qt::black));
             }
         }
         else {
-            painter->setPen(QPen(Qt::gray));
+            painter.setPen(QPen(Qt::gray));
         }
-        painter->setBrush(Qt::NoBrush);
-        painter->drawPath(path);
+        painter.setBrush(Qt::NoBrush);
+        painter.drawPath(path);
     }
 
-    Qt::CheckState checkStat = Qt::CheckState(qvariant_cast<int>(index.data(Qt::CheckStateRole)));
-    if (checkStat == Qt::CheckState::Checked)
+    if (checked)
     {
-        painter->setPen(QPen(Qt::blue));
-        painter->setBrush(QColor(229, 241, 255));
-        painter->drawPath(path);
+        painter.setPen(QPen(Qt::blue));
+        painter.setBrush(QColor(229, 241, 255));
+        painter.drawPath(path);
     }
 
     //绘制按钮
     QStyleOptionButton cbOpt;
     QRect buttonRect(rect.left() + 10, rect.top() + 4, 16, 16);
     cbOpt.rect = buttonRect;
-    cbOpt.state |= checkStat == Qt::CheckState::Checked ? QStyle::State_On : QStyle::State_Off;
-    if (data.isWeChatImage)
+    cbOpt.state |= checked ? QStyle::State_On : QStyle::State_Off;
+    if (isWeChatImage)
     {
         cbOpt.state |= QStyle::State_Enabled;
     }
-    QApplication::style()->drawControl(QStyle::CE_RadioButton, &cbOpt, painter, option.widget);
+    QApplication::style()->drawControl(QStyle::CE_RadioButton, &cbOpt, &painter, option.widget);
 
     // 绘制缩略图
-    //LOG_INFO << "thumbnail.width " << thumbnail.width() << " thumbnail.height " << thumbnail.height();
+    if (thumbnail.isNull())
+    {
+        // 缩略图还在后台加载, 先画占位框
+        QRect placeholderRect = QRect(
+            rect.left() + (rect.width() - _thumbnailSize.width()) / 2,
+            rect.top() + (rect.height() - 50 - _thumbnailSize.height()) / 2,
+            _thumbnailSize.width(),
+            _thumbnailSize.height());
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QColor(240, 240, 240));
+        painter.drawRect(placeholderRect);
+    }
+    // 切换档位后新缩略图到达前, 旧的大缩略图缩放到当前网格内显示
+    QSize pixmapSize = thumbnail.deviceIndependentSize().toSize();
+    if (pixmapSize.width() > _thumbnailSize.width() || pixmapSize.height() > _thumbnailSize.height())
+    {
+        pixmapSize.scale(_thumbnailSize, Qt::KeepAspectRatio);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    }
     QRect pixmapRect = QRect(
-        rect.left() + (rect.width() - data.thumbnail.width()) / 2,
-        rect.top() + (rect.height() - 50 - data.thumbnail.height() ) / 2,
-        data.thumbnail.width(),
-        data.thumbnail.height());
-    painter->drawPixmap(pixmapRect, data.thumbnail);
-    //LOG_INFO << "pixmapRect.left " << pixmapRect.left() << " pixmapRect.top " << pixmapRect.top();
+        rect.left() + (rect.width() - pixmapSize.width()) / 2,
+        rect.top() + (rect.height() - 50 - pixmapSize.height() ) / 2,
+        pixmapSize.width(),
+        pixmapSize.height());
+    painter.drawPixmap(pixmapRect, thumbnail);
+
+    const ThumbnailText& text = displayText(index, rowKey);
 
     //绘制名字
-    QRect nameRect = QRect(rect.left() + 8, rect.bottom() - 60, THUMBNAIL_WIDE - 4, 20);
-    if (!data.fileInfo.isFile() || isImageFile)
+    QRect nameRect = QRect(rect.left() + 8, rect.bottom() - 60, _thumbnailSize.width() - 4, 20);
+    if (!isFile || isImageFile)
     {
-        painter->setPen(QPen(Qt::black));
+        painter.setPen(QPen(Qt::black));
     }
     else {
-        painter->setPen(QPen(Qt::gray));
+        painter.setPen(QPen(Qt::gray));
     }
-    painter->setFont(QFont("Fixedsys", 12));
-    painter->drawText(nameRect, Qt::AlignLeft, painter->fontMetrics().elidedText(data.fileInfo.fileName(), Qt::ElideRight, THUMBNAIL_WIDE - 4));
-    //LOG_INFO << "NameRect.left " << NameRect.left() << " NameRect.top " << NameRect.top();
+    painter.setFont(_font);
+    painter.drawText(nameRect, Qt::AlignLeft, text.name);
 
     //绘制文件大小
-    QRect sizeRect = QRect(rect.left() + 8, rect.bottom() - 40, THUMBNAIL_WIDE - 4, 20);
-    painter->drawText(sizeRect, Qt::AlignLeft, fileSizeToString(data.fileInfo.size()));
+    QRect sizeRect = QRect(rect.left() + 8, rect.bottom() - 40, _thumbnailSize.width() - 4, 20);
+    painter.drawText(sizeRect, Qt::AlignLeft, text.size);
 
     //绘制文件日期
-    QRect dateRect = QRect(rect.left() + 8, rect.bottom() - 20, THUMBNAIL_WIDE - 4, 20);
-    painter->drawText(dateRect, Qt::AlignLeft, data.fileInfo.lastModified().toString("yyyy-MM-dd"));
+    QRect dateRect = QRect(rect.left() + 8, rect.bottom() - 20, _thumbnailSize.width() - 4, 20);
+    painter.drawText(dateRect, Qt::AlignLeft, text.date);
 
-    painter->restore();
+    return tile;
 }
 
 QSize ThumbnailDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const
 {
-    return QSize(THUMBNAIL_WIDE + 4, THUMBNAIL_HEIGHT + 100);
+    return QSize(_thumbnailSize.width() + 4, _thumbnailSize.height() + 100);
 }
 
 QWidget* ThumbnailDelegate::createEditor(QWidget* parent, const QStyleOptionViewItem& option, const QModelIndex& index) const
@@ -152,13 +237,7 @@ QWidget* ThumbnailDelegate::createEditor(QWidget* parent, const QStyleOptionView
 
 bool ThumbnailDelegate::editorEvent(QEvent* event, QAbstractItemModel* model, const QStyleOptionViewItem& option, const QModelIndex& index)
 {
-    QVariant variant = index.data(Qt::UserRole + 3);
-    if (variant.isNull())
-    {
-        return false;
-    }
-    ThumbnailData data = variant.value<ThumbnailData>();
-    if (!data.isWeChatImage)
+    if (!index.data(IsWeChatImageRole).toBool())
     {
         return false;
     }
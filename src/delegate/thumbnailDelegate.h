@@ -3,6 +3,11 @@
 
 #include <QStyledItemDelegate>
 #include <QModelIndex>
+#include <QCache>
+#include <QFont>
+#include <QFontMetrics>
+#include <QPainterPath>
+#include <QPixmap>
 
 class ImageCore;
 
@@ -19,12 +24,51 @@ public:
     void paint(QPainter * painter,const QStyleOptionViewItem & option,const QModelIndex & index) const override;
     QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
     QWidget* createEditor(QWidget* parent, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+    // 缩略图网格尺寸, 改变后清空合成缓存, 视图需要重新布局
+    void setThumbnailSize(const QSize& size);
+    QSize thumbnailSize() const { return _thumbnailSize; }
 protected:
     //处理鼠标事件
     bool editorEvent(QEvent* event, QAbstractItemModel* model, const QStyleOptionViewItem& option, const QModelIndex& index) override;
 
 private:
     ImageCore* _imageCore;
+
+    // 每行显示的文字, 第一次合成时生成
+    struct ThumbnailText
+    {
+        QString name;
+        QString size;
+        QString date;
+    };
+
+    // 合成好的整个瓦片, 缩略图变化后重新合成
+    struct ThumbnailTile
+    {
+        QPixmap pixmap;
+        qint64 thumbnailKey;
+    };
+
+    QSize _thumbnailSize;
+
+    QFont _font;
+    QFontMetrics _fontMetrics;
+
+    mutable QPainterPath _framePath;
+    mutable QSize _frameSize;
+
+    // key: 行标识 << 2 | 选中 << 1 | 悬停
+    mutable QCache<quint64, ThumbnailTile> _tiles;
+    // key: 行标识
+    mutable QCache<quint64, ThumbnailText> _texts;
+
+    const ThumbnailText& displayText(const QModelIndex& index, quint64 rowKey) const;
+
+    const QPainterPath& framePath(const QSize& size) const;
+
+    QPixmap renderTile(const QStyleOptionViewItem& option, const QModelIndex& index,
+        quint64 rowKey, bool checked, bool hover, qreal dpr) const;
 };
 
 #endif // THUMBNAILDELEGATE_H
@@ -0,0 +1,227 @@
+#include "directoryenumerator.h"
+#include "../util/imagefiletype.h"
+
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QThreadPool>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#endif
+
+// 第一批的数量, 够填满第一屏
+#define ENUM_FIRST_BATCH 64
+// 之后每批最多的数量和最长的间隔(ms)
+#define ENUM_BATCH 2048
+#define ENUM_BATCH_INTERVAL 100
+
+QCollator fileNameCollator()
+{
+    QCollator collator;
+    collator.setNumericMode(true);
+    return collator;
+}
+
+DirectoryEnumerator::DirectoryEnumerator(QObject* parent) : QObject(parent)
+{
+    qRegisterMetaType<QList<DirEntry>>();
+    qRegisterMetaType<DirChanges>();
+}
+
+DirectoryEnumerator::~DirectoryEnumerator()
+{
+    cancel();
+}
+
+void DirectoryEnumerator::cancel()
+{
+    if (!_cancelled.isNull())
+    {
+        *_cancelled = true;
+        _cancelled.clear();
+    }
+}
+
+// 遍历目录, 对每个名字调用 onName, 返回false时停止
+template <typename Func>
+static void listDirectory(const QString& path, Func onName)
+{
+#ifdef Q_OS_LINUX
+    DIR* dir = opendir(QFile::encodeName(path).constData());
+    if (nullptr == dir)
+    {
+        return;
+    }
+    while (struct dirent* entry = readdir(dir))
+    {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+        if (!onName(QFile::decodeName(name)))
+        {
+            break;
+        }
+    }
+    closedir(dir);
+#else
+    QDirIterator it(path, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    while (it.hasNext())
+    {
+        it.next();
+        if (!onName(it.fileName()))
+        {
+            break;
+        }
+    }
+#endif
+}
+
+// 在后台线程中读取属性和分类
+static DirEntry makeEntry(const QCollator& collator, const QString& dirPath, const QString& name)
+{
+    DirEntry entry;
+    entry.fileInfo = QFileInfo(dirPath + name);
+    entry.sortKey = collator.sortKey(name);
+    entry.fileInfo.stat();
+    if (entry.fileInfo.isFile())
+    {
+        entry.isWeChatImage = isWeChatImageFile(entry.fileInfo);
+        entry.isImage = classifyImageFile(entry.fileInfo);
+    }
+    return entry;
+}
+
+void DirectoryEnumerator::start(const QString& path)
+{
+    cancel();
+    _listing.clear();
+    QSharedPointer<std::atomic_bool> cancelled = QSharedPointer<std::atomic_bool>::create(false);
+    _cancelled = cancelled;
+    QPointer<DirectoryEnumerator> target(this);
+
+    // 在主线程中发出, 取消后丢弃
+    auto post = [target, cancelled](std::function<void()> emitter) {
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [target, cancelled, emitter]() {
+            if (!*cancelled && !target.isNull())
+            {
+                emitter();
+            }
+            }, Qt::QueuedConnection);
+    };
+
+    QThreadPool::globalInstance()->start([path, cancelled, target, post]() {
+        const QString dirPath = path.endsWith(QLatin1Char('/')) ? path : path + QLatin1Char('/');
+        QList<DirEntry> batch;
+        batch.reserve(ENUM_FIRST_BATCH);
+        int batchLimit = ENUM_FIRST_BATCH;
+        int count = 0;
+        QElapsedTimer timer;
+        timer.start();
+        // QCollator 不能跨线程共享, 每次枚举一个
+        const QCollator collator = fileNameCollator();
+        DirListing listing;
+
+        listDirectory(path, [&](const QString& name) {
+            if (*cancelled)
+            {
+                return false;
+            }
+            // 属性和类型在后台线程读取, 主线程使用缓存的结果
+            DirEntry entry = makeEntry(collator, dirPath, name);
+            listing.insert(name, DirStamp{ entry.fileInfo.size(), entry.fileInfo.lastModified().toMSecsSinceEpoch() });
+            batch.append(entry);
+            ++count;
+            if (batch.size() >= batchLimit || timer.elapsed() >= ENUM_BATCH_INTERVAL)
+            {
+                post([target, batch]() { emit target->entriesReady(batch); });
+                batch.clear();
+                batchLimit = ENUM_BATCH;
+                timer.restart();
+            }
+            return true;
+        });
+        if (*cancelled)
+        {
+            return;
+        }
+        if (!batch.isEmpty())
+        {
+            post([target, batch]() { emit target->entriesReady(batch); });
+        }
+        post([target, path, count, listing]() {
+            target->_listing = listing;
+            emit target->finished(path, count);
+            });
+    });
+}
+
+void DirectoryEnumerator::rescan(const QString& path)
+{
+    cancel();
+    QSharedPointer<std::atomic_bool> cancelled = QSharedPointer<std::atomic_bool>::create(false);
+    _cancelled = cancelled;
+    QPointer<DirectoryEnumerator> target(this);
+    // 隐式共享, 不复制
+    const DirListing previous = _listing;
+
+    QThreadPool::globalInstance()->start([path, cancelled, target, previous]() {
+        const QString dirPath = path.endsWith(QLatin1Char('/')) ? path : path + QLatin1Char('/');
+        const QCollator collator = fileNameCollator();
+        DirListing listing;
+        listing.reserve(previous.size());
+        DirChanges changes;
+
+        listDirectory(path, [&](const QString& name) {
+            if (*cancelled)
+            {
+                return false;
+            }
+            QFileInfo fileInfo(dirPath + name);
+            fileInfo.stat();
+            const DirStamp stamp{ fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch() };
+            listing.insert(name, stamp);
+            auto it = previous.constFind(name);
+            if (it == previous.constEnd())
+            {
+                changes.added.append(makeEntry(collator, dirPath, name));
+            }
+            else if (it->size != stamp.size || it->mtime != stamp.mtime)
+            {
+                changes.modified.append(makeEntry(collator, dirPath, name));
+            }
+            return true;
+        });
+        if (*cancelled)
+        {
+            return;
+        }
+        // 新名字都在 added 中, 剩下的数量比上次少说明有文件被删除
+        if (listing.size() - changes.added.size() < previous.size())
+        {
+            for (auto it = previous.constBegin(); it != previous.constEnd(); ++it)
+            {
+                if (!listing.contains(it.key()))
+                {
+                    changes.removed.append(it.key());
+                }
+            }
+        }
+
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [target, cancelled, path, listing, changes]() {
+            if (*cancelled || target.isNull())
+            {
+                return;
+            }
+            target->_listing = listing;
+            if (!changes.isEmpty())
+            {
+                emit target->changed(path, changes);
+            }
+            emit target->finished(path, int(listing.size()));
+            }, Qt::QueuedConnection);
+    });
+}
@@ -0,0 +1,90 @@
+#ifndef DIRECTORYENUMERATOR_H
+#define DIRECTORYENUMERATOR_H
+
+#include <QObject>
+#include <QFileInfo>
+#include <QList>
+#include <QSharedPointer>
+#include <QCollator>
+#include <QHash>
+
+#include <atomic>
+#include <optional>
+
+// 后台线程中已经读取属性和分类的目录项
+struct DirEntry
+{
+    QFileInfo fileInfo;
+    bool isImage = false;
+    bool isWeChatImage = false;
+    // 文件名排序键, 后台线程中生成
+    std::optional<QCollatorSortKey> sortKey;
+};
+
+// 文件名排序规则: 按当前语言, 数字按数值比较(file2 < file10)
+QCollator fileNameCollator();
+
+Q_DECLARE_METATYPE(DirEntry);
+
+// 上次枚举时每个文件的大小和修改时间(ms), 用于找出变化的文件
+struct DirStamp
+{
+    qint64 size = 0;
+    qint64 mtime = 0;
+};
+
+typedef QHash<QString, DirStamp> DirListing;
+
+// 与上次枚举相比的变化, added/modified 已经在后台读取属性和分类
+struct DirChanges
+{
+    QList<DirEntry> added;
+    QList<DirEntry> modified;
+    QStringList removed;
+
+    bool isEmpty() const { return added.isEmpty() && modified.isEmpty() && removed.isEmpty(); }
+};
+
+Q_DECLARE_METATYPE(DirChanges);
+
+//************************************
+// 后台枚举目录, 分批把目录项发回主线程
+// 第一批很小, 尽快显示第一屏; 之后按时间或数量合并成大批
+// Linux 直接用 readdir(内部为 getdents64), 其它平台用 QDirIterator
+// 后台任务只用 classifyImageFile 等自由函数分类, 不引用 ImageCore, 对象销毁后任务仍可安全结束
+//************************************
+class DirectoryEnumerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryEnumerator(QObject* parent = nullptr);
+    ~DirectoryEnumerator() override;
+
+    // 开始枚举, 未完成的上一次枚举被取消, 之后不会再收到它的信号
+    void start(const QString& path);
+
+    void cancel();
+
+    //************************************
+    // Method:    rescan
+    // 重新枚举目录并与上次的结果比较, 只对新增和变化的文件读取属性和分类
+    // 有变化时先发出 changed, 之后总是发出 finished; 未完成的上一次枚举被取消
+    //************************************
+    void rescan(const QString& path);
+
+signals:
+    void entriesReady(const QList<DirEntry>& entries);
+
+    void finished(const QString& path, int count);
+
+    void changed(const QString& path, const DirChanges& changes);
+
+private:
+    // 最近一次完成的枚举结果, 只在主线程中读写
+    DirListing _listing;
+
+    QSharedPointer<std::atomic_bool> _cancelled;
+};
+
+#endif // DIRECTORYENUMERATOR_H
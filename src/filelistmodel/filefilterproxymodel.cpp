@@ -7,8 +7,50 @@
 
 
 FileFilterProxyModel::FileFilterProxyModel(int sortColumn) : 
-    _useFilter(false), _sortColumn(sortColumn)
+    _useFilter(false), _sortColumn(sortColumn), _rankColumn(-1)
 {
+    naturalCompare = fileNameCollator();
+}
+
+void FileFilterProxyModel::setSourceModel(QAbstractItemModel* sourceModel)
+{
+    if (nullptr != this->sourceModel())
+    {
+        disconnect(this->sourceModel(), &QAbstractItemModel::modelAboutToBeReset, this, &FileFilterProxyModel::clearRanks);
+        disconnect(this->sourceModel(), &QAbstractItemModel::rowsAboutToBeRemoved, this, &FileFilterProxyModel::clearRanks);
+        disconnect(this->sourceModel(), &QAbstractItemModel::rowsAboutToBeMoved, this, &FileFilterProxyModel::clearRanks);
+        disconnect(this->sourceModel(), &QAbstractItemModel::dataChanged, this, &FileFilterProxyModel::onSourceDataChanged);
+    }
+    clearRanks();
+    // 行号变化后名次失效, 必须在代理模型处理之前清掉
+    if (nullptr != sourceModel)
+    {
+        connect(sourceModel, &QAbstractItemModel::modelAboutToBeReset, this, &FileFilterProxyModel::clearRanks);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, &FileFilterProxyModel::clearRanks);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeMoved, this, &FileFilterProxyModel::clearRanks);
+        connect(sourceModel, &QAbstractItemModel::dataChanged, this, &FileFilterProxyModel::onSourceDataChanged);
+    }
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
+void FileFilterProxyModel::clearRanks()
+{
+    _ranks.clear();
+    _rankColumn = -1;
+}
+
+void FileFilterProxyModel::onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles)
+{
+    if (!roles.isEmpty() && !roles.contains(Qt::DisplayRole))
+    {
+        return;
+    }
+    // 没有名次的行用 lessThan 比较, 与其它行的名次仍是同一个全序
+    const int last = qMin(bottomRight.row(), int(_ranks.size()) - 1);
+    for (int row = topLeft.row(); row <= last; ++row)
+    {
+        _ranks[row] = -1;
+    }
 }
 
 // filter
@@ -38,26 +80,34 @@ bool FileFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex& so
 void FileFilterProxyModel::sort(int column, Qt::SortOrder order)
 {
     _sortColumn = column;
+    // 先并行排好名次, 代理模型内部排序时只比较整数
+    auto* lmodel = qobject_cast<FileListModel*>(sourceModel());
+    if (nullptr != lmodel && column >= 0)
+    {
+        _ranks = lmodel->sortRanks(column);
+        _rankColumn = column;
+    }
     QSortFilterProxyModel::sort(column, order);
 }
 
 bool FileFilterProxyModel::lessThan(const QModelIndex& left, const QModelIndex& right) const
 {
-    auto srcModel = dynamic_cast<QStandardItemModel*>(sourceModel());
-    if (nullptr != srcModel)
-    {
-        QStandardItem* const l = srcModel->item(left.row(), left.column());
-        QStandardItem* const r = srcModel->item(right.row(), right.column());
+    const int sortColumn = left.column();
 
-        if (!l && r)
-            return true;
-        else if (!r && l)
-            return false;
-        else if (!l && !r)
-            return false;
+    // 文件列表模型直接按行读取各列数组, 不构造 QFileInfo
+    auto* lmodel = qobject_cast<FileListModel*>(sourceModel());
+    if (nullptr != lmodel)
+    {
+        const int l = left.row();
+        const int r = right.row();
+        if (sortColumn == _rankColumn && l < _ranks.size() && r < _ranks.size()
+            && _ranks.at(l) >= 0 && _ranks.at(r) >= 0)
+        {
+            return _ranks.at(l) < _ranks.at(r);
+        }
+        // 名次与 lessThan 是同一个全序, 可以混用
+        return lmodel->lessThan(sortColumn, l, r);
     }
- 
-    const int sortColumn = left.column();
 
     QFileInfo leftInfo = this->fileInfoByModel(left);
     QFileInfo rightInfo = this->fileInfoByModel(right);
@@ -130,7 +180,7 @@ QModelIndex FileFilterProxyModel::proxyIndex(const QString& path, int column) co
     auto* lmodel = dynamic_cast<FileListModel*>(sourceModel());
     if (lmodel)
     {
-        mapFromSource(lmodel->index(path, column));
+        return mapFromSource(lmodel->index(path, column));
     }
     return QModelIndex();
 }
@@ -170,21 +220,6 @@ QFileInfo FileFilterProxyModel::fileInfoByModel(const QModelIndex& index) const
     return QFileInfo();
 }
 
-QStandardItem* FileFilterProxyModel::itemFromIndex(const QModelIndex& index) const
-{
-    auto* model = dynamic_cast<QFileSystemModel*>(sourceModel());
-    if (model)
-    {
-        return nullptr;
-    }
-    auto* lmodel = dynamic_cast<FileListModel*>(sourceModel());
-    if (lmodel)
-    {
-        return lmodel->itemFromIndex(mapToSource(index));
-    }
-    return nullptr;
-}
-
 int FileFilterProxyModel::getSortColumn() const
 {
     return _sortColumn;
@@ -4,10 +4,10 @@
 #include <QSortFilterProxyModel>
 #include <QCollator>
 #include <QFileInfo>
-#include <QStandardItem>
 
 class QFileIconProvider;
 class QFileSystemModel;
+class FileListModel;
 
 class FileFilterProxyModel : public QSortFilterProxyModel
 {
@@ -18,11 +18,11 @@ public:
 
     void enableFilter(bool enable);
     void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+    void setSourceModel(QAbstractItemModel* sourceModel) override;
 
     QModelIndex proxyIndex(const QString& path, int column = 0) const;
     QFileInfo fileInfo(const QModelIndex& index) const;
     QFileInfo fileInfoByModel(const QModelIndex& index) const;
-    QStandardItem* itemFromIndex(const QModelIndex& index) const;
 
     int getSortColumn() const;
 protected:
@@ -36,6 +36,12 @@ private:
     bool _useFilter;
     int _sortColumn;
     QCollator naturalCompare;
+    // 文件列表模型按 _rankColumn 排序时各行的名次, 之后追加的行没有名次
+    QList<int> _ranks;
+    int _rankColumn;
+    void clearRanks();
+    // 行的内容变化后只作废这些行的名次, 缩略图和勾选变化不影响
+    void onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QList<int>& roles);
 };
 
 
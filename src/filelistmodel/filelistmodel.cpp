@@ -1,76 +1,166 @@
 #include "filelistmodel.h"
-#include "../delegate/thumbnailData.h"
 #include "../filesystemhelperfunctions.h"
 #include "../imagecore.h"
+#include "../util/parallelsort.h"
 
+#include <QDateTime>
 #include <QFileIconProvider>
 
-FileListModel::FileListModel(ImageCore* imageCore, QFileIconProvider* iconProvider, QObject* parent) : QStandardItemModel(0, NumberOfColumns, parent) {
+#include <algorithm>
+
+// 删除的行超过这么多段时不再逐段通知, 改为重置模型
+#define REMOVE_RANGE_LIMIT 64
+
+// 按行号保存的数据在删除 [first, first + count) 后前移
+template <typename T>
+static void shiftRows(QHash<int, T>& hash, int first, int count)
+{
+    if (hash.isEmpty())
+    {
+        return;
+    }
+    QHash<int, T> shifted;
+    shifted.reserve(hash.size());
+    for (auto it = hash.constBegin(); it != hash.constEnd(); ++it)
+    {
+        if (it.key() < first)
+            shifted.insert(it.key(), it.value());
+        else if (it.key() >= first + count)
+            shifted.insert(it.key() - count, it.value());
+    }
+    hash.swap(shifted);
+}
+
+FileListModel::FileListModel(ImageCore* imageCore, QFileIconProvider* iconProvider, QObject* parent) : QAbstractTableModel(parent) {
     this->_iconProvider = iconProvider;
     this->_imageCore = imageCore;
-    this->setHorizontalHeaderLabels(QStringList{ tr(""),tr("Name")/*, tr("Ext")*/, tr("Size"), tr("Date") });
+    this->_collator = fileNameCollator();
+    this->_generation = 0;
 }
 
 FileListModel::~FileListModel() = default;
 
-//QVariant FileListModel::data(const QModelIndex & index, int role /*= Qt::DisplayRole*/) const {
-//    return QStandardItemModel::data(index, role);
-//}
-//
-//bool FileListModel::setData(const QModelIndex & index, const QVariant & value, int role) {
-//
-//    return QStandardItemModel::setData(index, value, role);
-//}
-
-//Qt::ItemFlags FileListModel::flags(const QModelIndex& index) const {
-//    if (!index.isValid())
-//        return QAbstractItemModel::flags(index);
-//
-//    auto *item = this->itemFromIndex(index);
-//
-//    Qt::ItemFlags flags = item->isEnabled() ? Qt::ItemIsEnabled | Qt::ItemIsSelectable : QAbstractItemModel::flags(index);
-//
-//    return flags;
-//}
+int FileListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : int(_flags.size());
+}
 
-QFileInfo FileListModel::fileInfo(const QModelIndex& index) const
+int FileListModel::columnCount(const QModelIndex& parent) const
 {
-    if (!index.isValid()) {
-        return QFileInfo();
+    return parent.isValid() ? 0 : NumberOfColumns;
+}
+
+QVariant FileListModel::data(const QModelIndex& index, int role /*= Qt::DisplayRole*/) const
+{
+    if (!index.isValid() || index.row() >= rowCount())
+    {
+        return QVariant();
+    }
+    const int row = index.row();
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        switch (index.column())
+        {
+        case NameColumn:
+            return fileName(row).toString();
+        case SizeColumn:
+            return fileSizeToString(_size.at(row));
+        case DateColumn:
+            return QDateTime::fromMSecsSinceEpoch(_mtime.at(row)).toString("yyyy-MM-dd");
+        default:
+            return QVariant();
+        }
+    case Qt::DecorationRole:
+        return index.column() == NameColumn ? QVariant::fromValue(icon(row)) : QVariant();
+    case Qt::CheckStateRole:
+        return index.column() == CheckBoxColumn ? QVariant(int(isChecked(row) ? Qt::Checked : Qt::Unchecked)) : QVariant();
+    case ThumbnailRole: {
+        auto it = _thumbnails.constFind(row);
+        return QVariant::fromValue(it != _thumbnails.constEnd() ? it.value() : _staleThumbnails.value(row));
+    }
+    case IsWeChatImageRole:
+        return isWeChatImage(row);
+    case IsImageRole:
+        return isImage(row);
+    case IsFileRole:
+        return (_flags.at(row) & FileFlag) != 0;
+    case FileNameRole:
+        return fileName(row).toString();
+    case FileSizeRole:
+        return _size.at(row);
+    case LastModifiedRole:
+        return _mtime.at(row);
+    case RowKeyRole:
+        return (quint64(_generation) << 32) | quint64(row);
+    case ThumbnailKeyRole: {
+        auto it = _thumbnails.constFind(row);
+        if (it == _thumbnails.constEnd())
+        {
+            it = _staleThumbnails.constFind(row);
+            return it == _staleThumbnails.constEnd() ? qint64(0) : it.value().cacheKey();
+        }
+        return it.value().cacheKey();
+    }
+    default:
+        return QVariant();
     }
-   
-    QStandardItem* item = this->itemFromIndex(index);
-    if (item)
+}
+
+bool FileListModel::setData(const QModelIndex& index, const QVariant& value, int role)
+{
+    if (!index.isValid() || role != Qt::CheckStateRole)
     {
-        QVariant variant = item->data(Qt::UserRole + 3);
-        //if (variant.canConvert<ThumbnailData>())
-        //{
-            auto thumbnailData = variant.value<ThumbnailData>();
-            return thumbnailData.fileInfo;
-        //}
-        //return variant.value<QFileInfo>();
+        return false;
     }
-    return QFileInfo();
+    setChecked(index.row(), value.toInt() == Qt::Checked);
+    return true;
 }
 
-QFileInfo FileListModel::fileInfo(const QStandardItem* item) const
+QVariant FileListModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
-    if (item == nullptr)
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+    {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    switch (section)
+    {
+    case NameColumn: return tr("Name");
+    case SizeColumn: return tr("Size");
+    case DateColumn: return tr("Date");
+    default: return tr("");
+    }
+}
+
+Qt::ItemFlags FileListModel::flags(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return QAbstractItemModel::flags(index);
+
+    // 非图片文件显示为禁用
+    const quint8 flags = _flags.at(index.row());
+    if ((flags & FileFlag) && !(flags & ImageFlag))
     {
+        return Qt::NoItemFlags;
+    }
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+QFileInfo FileListModel::fileInfo(const QModelIndex& index) const
+{
+    if (!index.isValid()) {
         return QFileInfo();
     }
-    QVariant variant = item->data(Qt::UserRole + 3);
-    if (variant.isNull())
+    return fileInfo(index.row());
+}
+
+QFileInfo FileListModel::fileInfo(int row) const
+{
+    if (row < 0 || row >= rowCount())
     {
         return QFileInfo();
     }
-    //if (variant.canConvert<ThumbnailData>())
-    //{
-    //    auto data = variant.value<ThumbnailData>();
-    //    return data.fileInfo;
-    //}
-    auto data = variant.value<ThumbnailData>();
-    return data.fileInfo;
+    return QFileInfo(filePath(row));
 }
 
 QString FileListModel::type(const QModelIndex& index) const
@@ -85,58 +175,469 @@ QString FileListModel::type(const QFileInfo& fileInfo) const
 
 QModelIndex FileListModel::index(const QString& path, int column /*= 0*/) const
 {
+    const QFileInfo info(path);
+    QString dirPath = info.absolutePath();
+    if (!dirPath.endsWith(QLatin1Char('/')))
+    {
+        dirPath += QLatin1Char('/');
+    }
+    if (dirPath != _dirPath)
+    {
+        return QModelIndex();
+    }
+    const QString name = info.fileName();
+    for (int row = 0; row < rowCount(); ++row)
+    {
+        if (fileName(row) == name)
+        {
+            return index(row, column);
+        }
+    }
     return QModelIndex();
 }
 
-void FileListModel::updateItems(const QList<QFileInfo> fileInfos)
+QStringView FileListModel::fileName(int row) const
 {
-    this->removeRows(0, this->rowCount());
-    if (fileInfos.isEmpty())
+    return QStringView(_nameBuffer).mid(_nameOffset.at(row), _nameLength.at(row));
+}
+
+QString FileListModel::filePath(int row) const
+{
+    return _dirPath + fileName(row);
+}
+
+qint64 FileListModel::fileSize(int row) const
+{
+    return _size.at(row);
+}
+
+qint64 FileListModel::lastModified(int row) const
+{
+    return _mtime.at(row);
+}
+
+bool FileListModel::isDir(int row) const
+{
+    return (_flags.at(row) & DirFlag) != 0;
+}
+
+bool FileListModel::isImage(int row) const
+{
+    return (_flags.at(row) & ImageFlag) != 0;
+}
+
+bool FileListModel::isWeChatImage(int row) const
+{
+    return (_flags.at(row) & WeChatImageFlag) != 0;
+}
+
+bool FileListModel::isChecked(int row) const
+{
+    return (_flags.at(row) & CheckedFlag) != 0;
+}
+
+void FileListModel::setChecked(int row, bool checked)
+{
+    if (row < 0 || row >= rowCount() || isChecked(row) == checked)
     {
         return;
     }
-    //this->beginResetModel();
-    this->setRowCount(fileInfos.size());
-    int itemRow = 0;
-    for (const auto& fileInfo : fileInfos)
-    {
-        ThumbnailData data;
-        data.isWeChatImage = this->_imageCore->isWeChatImage(fileInfo);
-        data.fileInfo = fileInfo;
-    
-        auto checkBoxItem = new QStandardItem();
-        checkBoxItem->setData(QVariant::fromValue(data), Qt::UserRole + 3);
-        //checkBoxItem->setData(Qt::CheckState::Unchecked, Qt::CheckStateRole);
-        this->setItem(itemRow, CheckBoxColumn, checkBoxItem);
-
-        auto fileNameItem = new QStandardItem();
-        fileNameItem->setIcon(_iconProvider->icon(fileInfo));
-        fileNameItem->setData(fileInfo.fileName(), Qt::DisplayRole);
-        this->setItem(itemRow, NameColumn, fileNameItem);
-
-        //auto fileExtItem = new QStandardItem();
-        //fileExtItem->setData(fileInfo.suffix(), Qt::DisplayRole);
-        //fileListModel->setItem(itemRow, ExtColumn, fileExtItem);
-
-        auto sizeItem = new QStandardItem();
-        sizeItem->setData(fileSizeToString(fileInfo.size()), Qt::DisplayRole);
-        this->setItem(itemRow, SizeColumn, sizeItem);
-
-        auto dateItem = new QStandardItem();
-        dateItem->setData(fileInfo.lastModified().toString("yyyy-MM-dd"), Qt::DisplayRole);
-        this->setItem(itemRow, DateColumn, dateItem);
-
-        if (fileInfo.isFile() && !this->_imageCore->isImageFile(fileInfo))
+    if (checked)
+        _flags[row] |= CheckedFlag;
+    else
+        _flags[row] &= quint8(~CheckedFlag);
+    emit dataChanged(index(row, CheckBoxColumn), index(row, CheckBoxColumn), { Qt::CheckStateRole });
+}
+
+bool FileListModel::nameLess(int left, int right) const
+{
+    // place directories before files
+    const bool l = isDir(left);
+    const bool r = isDir(right);
+    if (l != r)
+        return l;
+    const int compare = _sortKeys.at(left).compare(_sortKeys.at(right));
+    if (compare != 0)
+        return compare < 0;
+    return left < right;
+}
+
+quint64 FileListModel::packedKey(int column, int row) const
+{
+    // 最高位为0的目录排在前面, 低63位为大小或偏移后的修改时间
+    const quint64 fileBit = isDir(row) ? 0 : (quint64(1) << 63);
+    const qint64 value = column == SizeColumn ? _size.at(row) : _mtime.at(row) + (qint64(1) << 62);
+    return fileBit | (quint64(qMax<qint64>(value, 0)) & ((quint64(1) << 63) - 1));
+}
+
+bool FileListModel::lessThan(int column, int left, int right) const
+{
+    switch (column) {
+    case SizeColumn:
+    case DateColumn: {
+        const quint64 l = packedKey(column, left);
+        const quint64 r = packedKey(column, right);
+        if (l != r)
+            return l < r;
+        return nameLess(left, right);
+    }
+    default:
+        return nameLess(left, right);
+    }
+}
+
+QList<int> FileListModel::sortRanks(int column) const
+{
+    const int count = rowCount();
+    QList<int> order(count);
+    if (column == SizeColumn || column == DateColumn)
+    {
+        // 先按名字排好, 再按 (目录, 大小/时间) 做稳定的基数排序, 结果即 (目录, 大小/时间, 名字)
+        const QList<int> nameRanks = sortRanks(NameColumn);
+        for (int row = 0; row < count; ++row)
+        {
+            order[nameRanks[row]] = row;
+        }
+        QList<quint64> keys(count);
+        for (int i = 0; i < count; ++i)
         {
-            for (int i = CheckBoxColumn; i < NumberOfColumns; ++i )
+            keys[i] = packedKey(column, order[i]);
+        }
+        parallelRadixSort(keys, order);
+    }
+    else
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            order[i] = i;
+        }
+        parallelSort(order, [this](int left, int right) { return nameLess(left, right); });
+    }
+    QList<int> ranks(count);
+    for (int i = 0; i < count; ++i)
+    {
+        ranks[order[i]] = i;
+    }
+    return ranks;
+}
+
+QPixmap FileListModel::thumbnail(int row) const
+{
+    return _thumbnails.value(row);
+}
+
+void FileListModel::setThumbnail(int row, const QPixmap& pixmap)
+{
+    if (row < 0 || row >= rowCount())
+    {
+        return;
+    }
+    _thumbnails.insert(row, pixmap);
+    _staleThumbnails.remove(row);
+    // 视图只重绘这一项
+    emit dataChanged(index(row, CheckBoxColumn), index(row, CheckBoxColumn), { ThumbnailRole });
+}
+
+void FileListModel::markThumbnailsStale()
+{
+    // 只遍历已加载的缩略图, 与目录大小无关
+    for (auto it = _thumbnails.constBegin(); it != _thumbnails.constEnd(); ++it)
+    {
+        _staleThumbnails.insert(it.key(), it.value());
+    }
+    _thumbnails.clear();
+}
+
+QIcon FileListModel::icon(int row) const
+{
+    if (_flags.at(row) & OwnIconFlag)
+    {
+        auto it = _rowIcons.constFind(row);
+        if (it != _rowIcons.constEnd())
+        {
+            return it.value();
+        }
+        QIcon icon = _iconProvider->icon(fileInfo(row));
+        _rowIcons.insert(row, icon);
+        return icon;
+    }
+    const quint16 suffix = _suffixIndex.at(row);
+    auto it = _suffixIcons.constFind(suffix);
+    if (it != _suffixIcons.constEnd())
+    {
+        return it.value();
+    }
+    // 同后缀的文件共用第一次查询到的图标
+    QIcon icon = _iconProvider->icon(fileInfo(row));
+    _suffixIcons.insert(suffix, icon);
+    return icon;
+}
+
+quint16 FileListModel::internSuffix(const QString& suffix)
+{
+    auto it = _suffixLookup.constFind(suffix);
+    if (it != _suffixLookup.constEnd())
+    {
+        return it.value();
+    }
+    const quint16 index = quint16(qMin<qsizetype>(_suffixes.size(), 0xFFFF));
+    if (index < 0xFFFF)
+    {
+        _suffixes.append(suffix);
+        _suffixLookup.insert(suffix, index);
+    }
+    return index;
+}
+
+void FileListModel::setDirectory(const QString& dirPath)
+{
+    beginResetModel();
+    ++_generation;
+    _dirPath = dirPath.endsWith(QLatin1Char('/')) ? dirPath : dirPath + QLatin1Char('/');
+    _nameBuffer.clear();
+    _nameOffset.clear();
+    _nameLength.clear();
+    _size.clear();
+    _mtime.clear();
+    _flags.clear();
+    _suffixIndex.clear();
+    _sortKeys.clear();
+    _thumbnails.clear();
+    _staleThumbnails.clear();
+    _rowIcons.clear();
+    // 后缀和后缀图标在目录间保留
+    endResetModel();
+}
+
+void FileListModel::appendItems(const QList<DirEntry>& entries)
+{
+    if (entries.isEmpty())
+    {
+        return;
+    }
+    const int firstRow = rowCount();
+    const int count = int(entries.size());
+    beginInsertRows(QModelIndex(), firstRow, firstRow + count - 1);
+    _nameOffset.reserve(firstRow + count);
+    _nameLength.reserve(firstRow + count);
+    _size.reserve(firstRow + count);
+    _mtime.reserve(firstRow + count);
+    _flags.reserve(firstRow + count);
+    _suffixIndex.reserve(firstRow + count);
+    _sortKeys.reserve(firstRow + count);
+    for (const auto& entry : entries)
+    {
+        const QFileInfo& fileInfo = entry.fileInfo;
+        const QString name = fileInfo.fileName();
+        _nameOffset.append(quint32(_nameBuffer.size()));
+        _nameLength.append(quint16(qMin<qsizetype>(name.size(), 0xFFFF)));
+        _nameBuffer.append(name);
+        _sortKeys.append(entry.sortKey ? *entry.sortKey : _collator.sortKey(name));
+        _size.append(fileInfo.size());
+        _mtime.append(fileInfo.lastModified().toMSecsSinceEpoch());
+
+        const QString suffix = fileInfo.suffix().toLower();
+        _flags.append(entryFlags(entry, suffix));
+        _suffixIndex.append(internSuffix(suffix));
+    }
+    endInsertRows();
+}
+
+quint8 FileListModel::entryFlags(const DirEntry& entry, const QString& suffix)
+{
+    const QFileInfo& fileInfo = entry.fileInfo;
+    quint8 flags = 0;
+    if (fileInfo.isDir())
+        flags |= DirFlag | OwnIconFlag;
+    if (fileInfo.isFile())
+        flags |= FileFlag;
+    if (entry.isImage)
+        flags |= ImageFlag;
+    if (entry.isWeChatImage)
+        flags |= WeChatImageFlag;
+    if (suffix == QStringLiteral("exe") || suffix == QStringLiteral("lnk") || suffix == QStringLiteral("ico"))
+        flags |= OwnIconFlag;
+    return flags;
+}
+
+void FileListModel::applyChanges(const DirChanges& changes)
+{
+    if (changes.isEmpty())
+    {
+        return;
+    }
+    if (!changes.modified.isEmpty() || !changes.removed.isEmpty())
+    {
+        // 行号会变, 委托中按行标识缓存的内容作废
+        ++_generation;
+
+        // 文件名 -> 行, 键指向 _nameBuffer, 删除行之前有效
+        QHash<QStringView, int> rows;
+        rows.reserve(rowCount());
+        for (int row = 0; row < rowCount(); ++row)
+        {
+            rows.insert(fileName(row), row);
+        }
+
+        for (const auto& entry : changes.modified)
+        {
+            const QString name = entry.fileInfo.fileName();
+            const int row = rows.value(QStringView(name), -1);
+            if (row < 0)
             {
-                this->item(itemRow, i)->setEnabled(false);
+                continue;
             }
+            const QString suffix = entry.fileInfo.suffix().toLower();
+            _size[row] = entry.fileInfo.size();
+            _mtime[row] = entry.fileInfo.lastModified().toMSecsSinceEpoch();
+            _flags[row] = entryFlags(entry, suffix) | (_flags.at(row) & CheckedFlag);
+            _suffixIndex[row] = internSuffix(suffix);
+            // 内容变了, 只丢弃这一行的缩略图和图标
+            _thumbnails.remove(row);
+            _staleThumbnails.remove(row);
+            _rowIcons.remove(row);
+            emit dataChanged(index(row, 0), index(row, NumberOfColumns - 1));
         }
 
-        itemRow++;
+        QList<int> removed;
+        removed.reserve(changes.removed.size());
+        for (const auto& name : changes.removed)
+        {
+            const int row = rows.value(QStringView(name), -1);
+            if (row >= 0)
+            {
+                removed.append(row);
+            }
+        }
+        std::sort(removed.begin(), removed.end());
+
+        int ranges = 0;
+        for (int i = 0; i < removed.size(); ++i)
+        {
+            if (i == 0 || removed.at(i) != removed.at(i - 1) + 1)
+                ++ranges;
+        }
+        if (ranges > REMOVE_RANGE_LIMIT)
+        {
+            // 逐段删除时代理模型每段都要调整映射, 段太多时一次重置更快
+            beginResetModel();
+            compactRows(removed);
+            endResetModel();
+        }
+        else
+        {
+            // 从后往前删, 前面的行号不变
+            for (int end = int(removed.size()); end > 0;)
+            {
+                int begin = end - 1;
+                while (begin > 0 && removed.at(begin - 1) == removed.at(begin) - 1)
+                {
+                    --begin;
+                }
+                const int first = removed.at(begin);
+                const int count = end - begin;
+                beginRemoveRows(QModelIndex(), first, first + count - 1);
+                removeRowRange(first, count);
+                endRemoveRows();
+                end = begin;
+            }
+            compactNames();
+        }
+    }
+    appendItems(changes.added);
+}
+
+void FileListModel::removeRowRange(int first, int count)
+{
+    // 文件名留在缓冲区中, 由 compactNames 回收
+    _nameOffset.remove(first, count);
+    _nameLength.remove(first, count);
+    _size.remove(first, count);
+    _mtime.remove(first, count);
+    _flags.remove(first, count);
+    _suffixIndex.remove(first, count);
+    _sortKeys.remove(first, count);
+    shiftRows(_thumbnails, first, count);
+    shiftRows(_staleThumbnails, first, count);
+    shiftRows(_rowIcons, first, count);
+}
+
+void FileListModel::compactNames()
+{
+    qsizetype used = 0;
+    for (const quint16 length : std::as_const(_nameLength))
+    {
+        used += length;
+    }
+    // 已删除的名字超过一半时才重建, 行号不变, 不需要通知视图
+    if (_nameBuffer.size() - used <= used)
+    {
+        return;
     }
-    //this->endResetModel();
-    //emit onUpdateItems();
+    QString nameBuffer;
+    nameBuffer.reserve(used);
+    for (int row = 0; row < rowCount(); ++row)
+    {
+        const QStringView name = fileName(row);
+        _nameOffset[row] = quint32(nameBuffer.size());
+        nameBuffer.append(name);
+    }
+    _nameBuffer.swap(nameBuffer);
 }
 
+void FileListModel::compactRows(const QList<int>& rows)
+{
+    QString nameBuffer;
+    qsizetype used = 0;
+    for (const quint16 length : std::as_const(_nameLength))
+    {
+        used += length;
+    }
+    for (const int row : rows)
+    {
+        used -= _nameLength.at(row);
+    }
+    // 只按保留的行分配, 删除的名字不再占用空间
+    nameBuffer.reserve(used);
+    QHash<int, QPixmap> thumbnails;
+    QHash<int, QPixmap> staleThumbnails;
+    QHash<int, QIcon> rowIcons;
+    int next = 0;
+    int out = 0;
+    for (int row = 0; row < rowCount(); ++row)
+    {
+        if (next < rows.size() && rows.at(next) == row)
+        {
+            ++next;
+            continue;
+        }
+        const QStringView name = fileName(row);
+        _nameOffset[out] = quint32(nameBuffer.size());
+        _nameLength[out] = _nameLength.at(row);
+        nameBuffer.append(name);
+        _size[out] = _size.at(row);
+        _mtime[out] = _mtime.at(row);
+        _flags[out] = _flags.at(row);
+        _suffixIndex[out] = _suffixIndex.at(row);
+        _sortKeys[out] = _sortKeys.at(row);
+        if (_thumbnails.contains(row))
+            thumbnails.insert(out, _thumbnails.value(row));
+        if (_staleThumbnails.contains(row))
+            staleThumbnails.insert(out, _staleThumbnails.value(row));
+        if (_rowIcons.contains(row))
+            rowIcons.insert(out, _rowIcons.value(row));
+        ++out;
+    }
+    const int removed = rowCount() - out;
+    _nameOffset.remove(out, removed);
+    _nameLength.remove(out, removed);
+    _size.remove(out, removed);
+    _mtime.remove(out, removed);
+    _flags.remove(out, removed);
+    _suffixIndex.remove(out, removed);
+    _sortKeys.remove(out, removed);
+    _nameBuffer.swap(nameBuffer);
+    _thumbnails.swap(thumbnails);
+    _staleThumbnails.swap(staleThumbnails);
+    _rowIcons.swap(rowIcons);
+}
@@ -1,30 +1,64 @@
 #pragma once
 
-#include <QStandardItemModel>
+#include <QAbstractTableModel>
 #include <QFileInfo>
+#include <QHash>
+#include <QIcon>
+#include <QPixmap>
+#include <QCollator>
+
+#include "directoryenumerator.h"
 
 enum FileListViewColumn {
     CheckBoxColumn, NameColumn, SizeColumn, DateColumn, NumberOfColumns
 };
 
+// 与列无关的自定义角色, 缩略图视图只使用第0列
+enum FileListRole {
+    ThumbnailRole = Qt::UserRole + 1,
+    IsWeChatImageRole,
+    IsImageRole,
+    IsFileRole,
+    FileNameRole,
+    FileSizeRole,
+    LastModifiedRole,
+    // 行标识: 目录代数 << 32 | 行号, 切换目录后不再相同
+    RowKeyRole,
+    // 缩略图的 QPixmap::cacheKey, 没有缩略图为0
+    ThumbnailKeyRole
+};
+
 class QFileIconProvider;
 class ImageCore;
 
-class FileListModel : public QStandardItemModel {
+//************************************
+// 文件列表模型, 按列存储(struct of arrays), data() 时再生成显示内容
+// 文件名连续存放在一个缓冲区中, 每行只有偏移/长度/大小/时间/标志
+// 缩略图只为加载过的行保存
+//************************************
+class FileListModel : public QAbstractTableModel {
     Q_OBJECT
 public:
     explicit FileListModel(ImageCore* imageCore, QFileIconProvider* iconProvider, QObject* parent = nullptr);
     ~FileListModel() override;
 
-    //QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    using QAbstractTableModel::index;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
 
-    //bool setData(const QModelIndex& index, const QVariant& value, int role) override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
-    //Qt::ItemFlags flags(const QModelIndex& index) const override;
+    bool setData(const QModelIndex& index, const QVariant& value, int role) override;
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
 
     QFileInfo fileInfo(const QModelIndex& index) const;
 
-    QFileInfo fileInfo(const QStandardItem* item) const;
+    QFileInfo fileInfo(int row) const;
 
     QString type(const QModelIndex& index) const;
 
@@ -32,10 +66,125 @@ public:
 
     QModelIndex index(const QString& path, int column = 0) const;
 
-    void updateItems(const QList<QFileInfo> fileInfos);
+    // 按行读取, 排序和绘制时不构造 QFileInfo
+    QStringView fileName(int row) const;
+
+    QString filePath(int row) const;
+
+    qint64 fileSize(int row) const;
+
+    // 毫秒, 自 1970-01-01 UTC
+    qint64 lastModified(int row) const;
+
+    bool isDir(int row) const;
+
+    bool isImage(int row) const;
+
+    bool isWeChatImage(int row) const;
+
+    bool isChecked(int row) const;
+
+    void setChecked(int row, bool checked);
+
+    //************************************
+    // Method:    lessThan
+    // 按列比较两行, 目录在前, 再按该列的值, 相等时依次按名字和行号, 是全序
+    // 可在多个线程中同时调用
+    //************************************
+    bool lessThan(int column, int left, int right) const;
+
+    //************************************
+    // Method:    sortRanks
+    // Returns:   QList<int> 每行在升序中的名次
+    // 对行号排列并行排序, 之后比较两行只需比较名次
+    //************************************
+    QList<int> sortRanks(int column) const;
+
+    // 同后缀共享的图标, 目录等按行缓存
+    QIcon icon(int row) const;
+
+    // 当前尺寸的缩略图, 过期的不返回
+    QPixmap thumbnail(int row) const;
+
+    void setThumbnail(int row, const QPixmap& pixmap);
+
+    // 缩略图尺寸改变时调用: 已有缩略图在新的到达前继续显示, 但 thumbnail() 不再返回
+    void markThumbnailsStale();
+
+    // 清空并切换到新目录
+    void setDirectory(const QString& dirPath);
+
+    // 追加一批目录项, 视图和代理模型只收到一次插入
+    void appendItems(const QList<DirEntry>& entries);
+
+    //************************************
+    // Method:    applyChanges
+    // 按目录变化增删改行, 不重建模型; 选中(勾选)状态保留
+    // 变化的行丢弃缩略图, 删除的行分段发出 rowsRemoved,
+    // 分段太多时改为一次重置, 视图需要自己恢复当前项
+    //************************************
+    void applyChanges(const DirChanges& changes);
 Q_SIGNALS:
     void onUpdateItems();
 private:
+    enum RowFlag : quint8 {
+        DirFlag = 0x01,
+        FileFlag = 0x02,
+        ImageFlag = 0x04,
+        WeChatImageFlag = 0x08,
+        CheckedFlag = 0x10,
+        // 图标因文件而异(目录/exe/lnk/ico), 不能按后缀共享
+        OwnIconFlag = 0x20
+    };
+
     QFileIconProvider* _iconProvider;
     ImageCore* _imageCore;
+
+    // 当前目录, 以 '/' 结尾
+    QString _dirPath;
+
+    // 每次切换目录递增
+    quint32 _generation;
+
+    QString _nameBuffer;
+    QList<quint32> _nameOffset;
+    QList<quint16> _nameLength;
+    QList<qint64> _size;
+    QList<qint64> _mtime;
+    QList<quint8> _flags;
+    // 后缀在 _suffixes 中的序号, 用于共享图标
+    QList<quint16> _suffixIndex;
+    // 文件名排序键, 比较时不再调用 QCollator::compare
+    QList<QCollatorSortKey> _sortKeys;
+
+    // 后台没有生成排序键时使用
+    QCollator _collator;
+
+    bool nameLess(int left, int right) const;
+
+    // 大小/日期列的64位排序键: (是否文件, 大小或修改时间)
+    quint64 packedKey(int column, int row) const;
+
+    QStringList _suffixes;
+    QHash<QString, quint16> _suffixLookup;
+
+    QHash<int, QPixmap> _thumbnails;
+    QHash<int, QPixmap> _staleThumbnails;
+
+    // 图标按需生成
+    mutable QHash<quint16, QIcon> _suffixIcons;
+    mutable QHash<int, QIcon> _rowIcons;
+
+    quint16 internSuffix(const QString& suffix);
+
+    static quint8 entryFlags(const DirEntry& entry, const QString& suffix);
+
+    // 删除连续的行 [first, first + count), 调用前后需 begin/endRemoveRows
+    void removeRowRange(int first, int count);
+
+    // 一次删除多个不连续的行并整理文件名缓冲区, rows 升序
+    void compactRows(const QList<int>& rows);
+
+    // 逐段删除后调用, 已删除的文件名占缓冲区一半以上时重建缓冲区
+    void compactNames();
 };
@@ -2,7 +2,6 @@
 #include "config.h"
 #include "filelistmodel/filefilterproxymodel.h"
 #include "delegate/thumbnailDelegate.h"
-#include "delegate/thumbnailData.h"
 #include "logger/Logger.h"
 #include "imageViewer.h"
 #include "models/imageswitcher.h"
@@ -27,6 +26,10 @@
 #include <QtConcurrent/QtConcurrent>
 #include <functional>
 #include <QMimeType>
+#include <QScrollBar>
+#include <QSet>
+#include <QWheelEvent>
+#include <QFileSystemWatcher>
 
 
 FileWidget::FileWidget(ImageCore* imageCore, QWidget* parent) : 
@@ -36,9 +39,30 @@ FileWidget::FileWidget(ImageCore* imageCore, QWidget* parent) :
     this->thumbnailModel = nullptr;
     this->fileListModel = nullptr;
     this->proxyModel = nullptr;
+    this->_enumerator = nullptr;
+    this->_enumStart = 0;
+    this->_enumerating = false;
+    this->_rescanPending = false;
 
     this->fileViewType = FileViewType::Table;
 
+    this->_thumbnailGeneration = 0;
+    this->_prefetchRows = 2;
+    this->_thumbnailTier = THUMBNAIL_DEFAULT_TIER;
+    // 滚动时合并请求
+    _thumbnailTimer.setSingleShot(true);
+    _thumbnailTimer.setInterval(30);
+    connect(&_thumbnailTimer, &QTimer::timeout, this, &FileWidget::requestVisibleThumbnails);
+
+    // 目录变化在一个间隔内只重新枚举一次, 连续写入上千个文件也只更新一次模型
+    _watcher = new QFileSystemWatcher(this);
+    connect(_watcher, &QFileSystemWatcher::directoryChanged, this, &FileWidget::onDirectoryChanged);
+    // 覆盖写入已有文件时目录不变, 靠监视可见的文件发现; 重新枚举时按大小和修改时间找出变化
+    connect(_watcher, &QFileSystemWatcher::fileChanged, this, &FileWidget::onDirectoryChanged);
+    _rescanTimer.setSingleShot(true);
+    _rescanTimer.setInterval(qMax(0, ConfigIni::getInstance().iniRead(QStringLiteral("FileList/rescanDelayMs"), 200).toInt()));
+    connect(&_rescanTimer, &QTimer::timeout, this, &FileWidget::rescanDirectory);
+
     QTimer::singleShot(100, this, &FileWidget::loadFileListInfo);
 
     // widget init
@@ -53,6 +77,7 @@ FileWidget::FileWidget(ImageCore* imageCore, QWidget* parent) :
 
 FileWidget::~FileWidget() {
     saveFileListInfo();
+    cancelThumbnails();
     if (nullptr != thumbnailDelegate)
     {
         delete thumbnailDelegate;
@@ -162,6 +187,51 @@ void FileWidget::initThumbnailView()
     thumbnailView->setResizeMode(QListView::Adjust);
     thumbnailView->setMovement(QListView::Static);
     connect(thumbnailView, &QListView::doubleClicked, this, &FileWidget::onFileDoubleClicked);
+    // 滚动或布局变化后重新计算可见范围
+    connect(thumbnailView->verticalScrollBar(), &QScrollBar::valueChanged, &_thumbnailTimer, qOverload<>(&QTimer::start));
+    connect(thumbnailView->verticalScrollBar(), &QScrollBar::rangeChanged, &_thumbnailTimer, qOverload<>(&QTimer::start));
+    // Ctrl+滚轮缩放网格
+    thumbnailView->viewport()->installEventFilter(this);
+}
+
+bool FileWidget::eventFilter(QObject* watched, QEvent* event)
+{
+    if (nullptr != thumbnailView && watched == thumbnailView->viewport() && event->type() == QEvent::Wheel)
+    {
+        QWheelEvent* wheelEvent = static_cast<QWheelEvent*>(event);
+        if (wheelEvent->modifiers().testFlag(Qt::ControlModifier))
+        {
+            const int delta = wheelEvent->angleDelta().y();
+            if (delta != 0)
+            {
+                setThumbnailTier(_thumbnailTier + (delta > 0 ? 1 : -1));
+            }
+            return true;
+        }
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void FileWidget::setThumbnailTier(int tier)
+{
+    tier = qBound(0, tier, THUMBNAIL_TIER_COUNT - 1);
+    if (tier == _thumbnailTier && thumbnailDelegate->thumbnailSize() == ImageCore::thumbnailTierSize(tier))
+    {
+        return;
+    }
+    DWORD start = GetTickCount();
+    _thumbnailTier = tier;
+    thumbnailDelegate->setThumbnailSize(ImageCore::thumbnailTierSize(tier));
+    // 旧尺寸的请求作废, 已有缩略图缩放显示到新的到达
+    cancelThumbnails();
+    ++_thumbnailGeneration;
+    if (nullptr != fileListModel)
+    {
+        fileListModel->markThumbnailsStale();
+    }
+    thumbnailView->doItemsLayout();
+    _thumbnailTimer.start();
+    LOG_INFO << "thumbnail tier: " << tier << " time: " << GetTickCount() - start;
 }
 
 void FileWidget::initWidgetLayout() {
@@ -193,9 +263,14 @@ void FileWidget::initListModel(const QString& path/*, bool readPixmap*/) {
     if (nullptr == fileListModel)
     {
         fileListModel = new FileListModel(this->_imageCore, ensureIconProvider());
-        fileListModel->setColumnCount(NumberOfColumns);
 
         proxyModel = new FileFilterProxyModel;
+        proxyModel->setSourceModel(fileListModel);
+
+        _enumerator = new DirectoryEnumerator(this);
+        connect(_enumerator, &DirectoryEnumerator::entriesReady, this, &FileWidget::onEntriesReady);
+        connect(_enumerator, &DirectoryEnumerator::finished, this, &FileWidget::onEnumerationFinished);
+        connect(_enumerator, &DirectoryEnumerator::changed, this, &FileWidget::onDirectoryContentChanged);
    
         thumbnailView->setModel(proxyModel);
         tableView->setModel(proxyModel);
@@ -204,19 +279,124 @@ void FileWidget::initListModel(const QString& path/*, bool readPixmap*/) {
         tableView->setAlternatingRowColors(true);
         //tableView->setFont(QFont("Fixedsys", 8));
     }
-    DWORD start = GetTickCount();
-    QList<QFileInfo> fileInfos = getRowItemList(path);
+    cancelThumbnails();
+    ++_thumbnailGeneration;
+    this->_imageCore->newGeneration();
 
     disconnect(thumbnailView->selectionModel(), &QItemSelectionModel::currentChanged, this, &FileWidget::onCurrentChanged);
     disconnect(tableView->selectionModel(), &QItemSelectionModel::currentChanged, this, &FileWidget::onCurrentChanged);
-    proxyModel->setSourceModel(nullptr);
-    this->fileListModel->updateItems(fileInfos);
-    proxyModel->setSourceModel(fileListModel);
+    this->fileListModel->setDirectory(path);
     // must after setModel 
     connect(thumbnailView->selectionModel(), &QItemSelectionModel::currentChanged, this, &FileWidget::onCurrentChanged);
     connect(tableView->selectionModel(), &QItemSelectionModel::currentChanged, this, &FileWidget::onCurrentChanged);
     tableView->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Fixed);
-    LOG_INFO << "updateItems time: " << GetTickCount() - start;
+
+    if (!_watcher->directories().isEmpty())
+    {
+        _watcher->removePaths(_watcher->directories());
+    }
+    if (!_watcher->files().isEmpty())
+    {
+        _watcher->removePaths(_watcher->files());
+    }
+    _watcher->addPath(path);
+    _rescanTimer.stop();
+    _rescanPending = false;
+
+    // 目录项由后台线程分批送来, 不阻塞界面
+    _enumStart = GetTickCount();
+    _enumerating = true;
+    _enumerator->start(path);
+}
+
+void FileWidget::onEntriesReady(const QList<DirEntry>& entries)
+{
+    this->fileListModel->appendItems(entries);
+    if (FileViewType::Thumbnail == fileViewType)
+    {
+        _thumbnailTimer.start();
+    }
+}
+
+void FileWidget::onEnumerationFinished(const QString& path, int count)
+{
+    LOG_INFO << "enumerate " << path << " count: " << count << " time: " << GetTickCount() - _enumStart;
+    _enumerating = false;
+    if (_rescanPending)
+    {
+        _rescanPending = false;
+        _rescanTimer.start();
+    }
+}
+
+void FileWidget::onDirectoryChanged()
+{
+    // 不重新计时, 持续写入时也按固定间隔更新
+    if (!_rescanTimer.isActive())
+    {
+        _rescanTimer.start();
+    }
+}
+
+void FileWidget::rescanDirectory()
+{
+    if (_enumerating)
+    {
+        _rescanPending = true;
+        return;
+    }
+    _enumStart = GetTickCount();
+    _enumerating = true;
+    _enumerator->rescan(currentPath);
+}
+
+void FileWidget::onDirectoryContentChanged(const QString& path, const DirChanges& changes)
+{
+    DWORD start = GetTickCount();
+    // 当前项和滚动位置, 模型重置时用来恢复
+    QAbstractItemView* view = FileViewType::Thumbnail == fileViewType
+        ? static_cast<QAbstractItemView*>(thumbnailView) : static_cast<QAbstractItemView*>(tableView);
+    const int currentColumn = qMax(0, view->currentIndex().column());
+    const QModelIndex current = proxyModel->mapToSource(view->currentIndex());
+    const QString currentFile = current.isValid() ? fileListModel->filePath(current.row()) : QString();
+    const int tableScroll = tableView->verticalScrollBar()->value();
+    const int thumbnailScroll = thumbnailView->verticalScrollBar()->value();
+
+    const bool rowsChanged = !changes.modified.isEmpty() || !changes.removed.isEmpty();
+    if (rowsChanged)
+    {
+        // 等待中的缩略图请求按行号记录, 行号要变
+        cancelThumbnails();
+        ++_thumbnailGeneration;
+        const QString dirPath = path.endsWith(QLatin1Char('/')) ? path : path + QLatin1Char('/');
+        for (const auto& entry : changes.modified)
+        {
+            this->_imageCore->invalidateFile(entry.fileInfo.absoluteFilePath());
+        }
+        for (const auto& name : changes.removed)
+        {
+            this->_imageCore->invalidateFile(dirPath + name);
+        }
+    }
+
+    fileListModel->applyChanges(changes);
+
+    if (!currentFile.isEmpty() && !view->currentIndex().isValid())
+    {
+        const QModelIndex restored = proxyModel->proxyIndex(currentFile, currentColumn);
+        if (restored.isValid())
+        {
+            view->selectionModel()->setCurrentIndex(restored, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+        }
+    }
+    tableView->verticalScrollBar()->setValue(tableScroll);
+    thumbnailView->verticalScrollBar()->setValue(thumbnailScroll);
+    if (FileViewType::Thumbnail == fileViewType)
+    {
+        _thumbnailTimer.start();
+    }
+    LOG_INFO << "directory changed " << path << " added: " << changes.added.size() << " modified: " << changes.modified.size()
+        << " removed: " << changes.removed.size() << " time: " << GetTickCount() - start;
 }
 
 void FileWidget::onUpdateItems()
@@ -251,40 +431,133 @@ void FileWidget::setTableColWidth()
 void FileWidget::setThumbnailView(const QString& path/*, bool readPixmap*/)
 {
     LOG_INFO << "setThumbnailView path: " << path/* << " readPixmap:" << readPixmap*/;
+    // 不再同步解码整个目录, 由可见范围驱动
+    _thumbnailTimer.start();
+}
+
+void FileWidget::cancelThumbnails()
+{
+    for (const auto& cancelled : std::as_const(_pendingThumbnails))
+    {
+        *cancelled = true;
+    }
+    _pendingThumbnails.clear();
+}
 
-    QList<QStandardItem*> itemInfos = getRowItemList();
-    if (itemInfos.isEmpty())
+void FileWidget::requestVisibleThumbnails()
+{
+    if (FileViewType::Thumbnail != fileViewType || nullptr == proxyModel || proxyModel->rowCount() == 0)
     {
         return;
     }
-    QFuture<QStandardItem*> future = QtConcurrent::mapped(itemInfos, [this/*, &readPixmap*/](QStandardItem* rowItem) -> QStandardItem*
+
+    const QRect viewport = thumbnailView->viewport()->rect();
+    const int spacing = thumbnailView->spacing();
+    const QSize itemSize = thumbnailDelegate->sizeHint(QStyleOptionViewItem(), QModelIndex()) + QSize(spacing * 2, spacing * 2);
+    const int perRow = qMax(1, viewport.width() / qMax(1, itemSize.width()));
+    const int rowCount = proxyModel->rowCount();
+
+    QModelIndex firstIndex = thumbnailView->indexAt(viewport.topLeft() + QPoint(spacing + 1, spacing + 1));
+    int first = firstIndex.isValid() ? firstIndex.row() : 0;
+    QModelIndex lastIndex = thumbnailView->indexAt(viewport.bottomRight() - QPoint(spacing + 1, spacing + 1));
+    int last = lastIndex.isValid() ? lastIndex.row() : qMin(rowCount - 1, first + perRow * (viewport.height() / qMax(1, itemSize.height()) + 1));
+    const int visibleFirst = first;
+    const int visibleLast = last;
+    first = qMax(0, first - perRow * _prefetchRows);
+    last = qMin(rowCount - 1, last + perRow * (_prefetchRows + 1));
+
+    QSet<int> wanted;
+    for (int r = first; r <= last; ++r)
+    {
+        const int sourceRow = proxyModel->mapToSource(proxyModel->index(r, 0)).row();
+        if (sourceRow < 0 || !fileListModel->thumbnail(sourceRow).isNull())
         {
-            QVariant variant = rowItem->data(Qt::UserRole + 3);
-            if (variant.isNull())
-            {
-                return rowItem;
-            }
+            continue;
+        }
+        if (!fileListModel->isImage(sourceRow))
+        {
+            // 非图片直接使用系统图标
+            fileListModel->setThumbnail(sourceRow, fileListModel->icon(sourceRow).pixmap(ICON_WIDE, ICON_HEIGHT));
+            continue;
+        }
+        wanted.insert(sourceRow);
+        if (_pendingThumbnails.contains(sourceRow))
+        {
+            continue;
+        }
+
+        const int generation = _thumbnailGeneration;
+        const DecodePriority priority = (r >= visibleFirst && r <= visibleLast) ? ThumbnailPriority : PrefetchPriority;
+        _pendingThumbnails.insert(sourceRow, this->_imageCore->decode(fileListModel->filePath(sourceRow),
+            thumbnailDelegate->thumbnailSize(), priority, this, [this, generation, sourceRow](ImageReadDataPtr image) {
+                onThumbnailLoaded(generation, sourceRow, image);
+            }));
+    }
+
+    watchVisibleFiles(visibleFirst, visibleLast);
+
+    // 滚出范围的请求取消
+    for (auto it = _pendingThumbnails.begin(); it != _pendingThumbnails.end();)
+    {
+        if (!wanted.contains(it.key()))
+        {
+            *it.value() = true;
+            it = _pendingThumbnails.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void FileWidget::watchVisibleFiles(int first, int last)
+{
+    QSet<QString> visible;
+    for (int r = first; r <= last; ++r)
+    {
+        const int sourceRow = proxyModel->mapToSource(proxyModel->index(r, 0)).row();
+        if (sourceRow >= 0 && fileListModel->isImage(sourceRow))
+        {
+            visible.insert(fileListModel->filePath(sourceRow));
+        }
+    }
+    // 只监视可见的图片, 文件句柄/inotify 数量与目录大小无关
+    QStringList stale;
+    const QStringList watched = _watcher->files();
+    for (const QString& file : watched)
+    {
+        if (!visible.remove(file))
+        {
+            stale.append(file);
+        }
+    }
+    if (!stale.isEmpty())
+    {
+        _watcher->removePaths(stale);
+    }
+    if (!visible.isEmpty())
+    {
+        _watcher->addPaths(QStringList(visible.cbegin(), visible.cend()));
+    }
+}
 
-            auto itemData = variant.value<ThumbnailData>();
-            itemData.isWeChatImage = this->_imageCore->isWeChatImage(itemData.fileInfo);
-
-            //if (readPixmap)
-            //{
-                if (this->_imageCore->isImageFile(itemData.fileInfo))
-                {
-                    const ImageReadData* image = _imageCore->readFile(itemData.fileInfo.absoluteFilePath());
-                    itemData.thumbnail = image->pixmap;
-                }
-                else {
-                    std::lock_guard<std::recursive_mutex> locker(fileIconMutex);
-                    auto icon = ensureIconProvider()->icon(itemData.fileInfo);
-                    itemData.thumbnail = icon.pixmap(ICON_WIDE, ICON_HEIGHT);
-                }
-            //}
-            rowItem->setData(QVariant::fromValue(itemData), Qt::UserRole + 3);
-            return rowItem;
-        });
-    future.waitForFinished();
+void FileWidget::onThumbnailLoaded(int generation, int sourceRow, ImageReadDataPtr image)
+{
+    if (generation != _thumbnailGeneration)
+    {
+        return;
+    }
+    _pendingThumbnails.remove(sourceRow);
+    if (image.isNull() || image->pixmap.isNull())
+    {
+        // 解码失败, 使用系统图标, 避免反复请求
+        fileListModel->setThumbnail(sourceRow, fileListModel->icon(sourceRow).pixmap(ICON_WIDE, ICON_HEIGHT));
+    }
+    else
+    {
+        fileListModel->setThumbnail(sourceRow, image->pixmap);
+    }
 }
 
 void FileWidget::thumbnail()
@@ -314,15 +587,10 @@ void FileWidget::selectAll()
 
     for (int r = 0; r < this->fileListModel->rowCount(); ++r)
     {
-        auto item = fileListModel->item(r);
-        auto fileInfo = fileListModel->fileInfo(item);
-        
-        if (this->_imageCore->isWeChatImage(fileInfo))
+        if (fileListModel->isWeChatImage(r))
         {
             // wechat
-            //item->setCheckState(item->checkState() == Qt::CheckState::Checked
-            //    ? Qt::CheckState::Unchecked : Qt::CheckState::Checked);
-            item->setCheckState(Qt::CheckState::Checked);
+            fileListModel->setChecked(r, true);
         }
     }
 }
@@ -332,11 +600,9 @@ void FileWidget::exportSelected()
     QList<QFileInfo> selects;
     for (int r = 0; r < this->fileListModel->rowCount(); ++r)
     {
-        auto item = fileListModel->item(r);
-       
-        if (item->checkState() == Qt::CheckState::Checked)
+        if (fileListModel->isChecked(r))
         {
-            selects.append(fileListModel->fileInfo(item));
+            selects.append(fileListModel->fileInfo(r));
         }
     }
     if (!selects.isEmpty())
@@ -355,11 +621,13 @@ void FileWidget::exportSelected()
 void FileWidget::onCurrentChanged(const QModelIndex& current, const QModelIndex& previous) {
     QFileInfo info = proxyModel->fileInfo(current.siblingAtColumn(0));
     LOG_INFO << "onCurrentChanged fileInfo: " << info;
-    if (info.isFile() && this->_imageCore->isImageFile(info)) {
+    // 使用枚举时已缓存的分类, 不再访问文件
+    const int sourceRow = proxyModel->mapToSource(current).row();
+    if (sourceRow >= 0 && fileListModel->isImage(sourceRow)) {
         this->_imageCore->loadFile(info.absoluteFilePath(), QSize(THUMBNAIL_WIDE_N, THUMBNAIL_HEIGHT_N));
     }
     else {
-        emit this->_imageCore->imageLoaded(nullptr);
+        emit this->_imageCore->imageLoaded(ImageReadDataPtr());
     }
 }
 
@@ -385,7 +653,8 @@ void FileWidget::onFileDoubleClicked(const QModelIndex& index)
         emit cdDir(target);
         return;
     }
-    if (this->_imageCore->isImageFile(info))
+    const int sourceRow = proxyModel->mapToSource(clicked).row();
+    if (sourceRow >= 0 && fileListModel->isImage(sourceRow))
     {
         ImageViewer* slideshow = new ImageViewer(this->_imageCore, new ImageSwitcher(clicked, this->proxyModel));
         slideshow->show();
@@ -399,28 +668,6 @@ void FileWidget::onTreeViewClicked(const QString& path)
     cdPath(path);
 }
 
-QList<QFileInfo> FileWidget::getRowItemList(const QString& currentDirPath)
-{
-    QList<QFileInfo> list;
-    list = QDir{ currentDirPath }.entryInfoList(
-        QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System, QDir::NoSort);
-    return list;
-}
-
-QList<QStandardItem*> FileWidget::getRowItemList()
-{
-    QList<QStandardItem*> list;
-    int row = this->fileListModel->rowCount();
-    for (int r = 0; r < row; ++r) {
-        QStandardItem* item = this->fileListModel->item(r);
-        if (item)
-        {
-            list.append(item);
-        }
-    }
-    return list;
-}
-
 void FileWidget::loadFileListInfo()
 {
     _sortColumn = ConfigIni::getInstance().iniRead(QStringLiteral("FileList/sortColumn"), "-1").toInt();
@@ -430,6 +677,8 @@ void FileWidget::loadFileListInfo()
     {
         _column1w = 256;
     }
+    _prefetchRows = qMax(0, ConfigIni::getInstance().iniRead(QStringLiteral("FileList/prefetchRows"), "2").toInt());
+    setThumbnailTier(ConfigIni::getInstance().iniRead(QStringLiteral("FileList/thumbnailTier"), THUMBNAIL_DEFAULT_TIER).toInt());
 }
 
 void FileWidget::saveFileListInfo()
@@ -440,5 +689,6 @@ void FileWidget::saveFileListInfo()
         ConfigIni::getInstance().iniWrite(QStringLiteral("FileList/sortOrder"), this->proxyModel->sortOrder());
     }
     ConfigIni::getInstance().iniWrite(QStringLiteral("FileList/column1w"), this->tableView->columnWidth(1));
+    ConfigIni::getInstance().iniWrite(QStringLiteral("FileList/thumbnailTier"), _thumbnailTier);
 }
 
@@ -13,8 +13,11 @@
 #include <QDir>
 #include <QMimeData>
 #include <QFileInfo>
+#include <QTimer>
+#include <QHash>
 
 #include "imagecore.h"
+#include "filelistmodel/directoryenumerator.h"
 
 class QToolBar;
 class QListView;
@@ -27,10 +30,10 @@ class QAbstractItemDelegate;
 class QStackedWidget;
 class FileFilterProxyModel;
 class QAbstractItemModel;
-class ThumbnailData;
 class QStandardItem;
 class CheckBoxDelegate;
 class QFileIconProvider;
+class QFileSystemWatcher;
 
 enum FileViewType {
     Table, Thumbnail
@@ -44,6 +47,8 @@ public:
 
     ~FileWidget() override;
 
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
     void setupToolBar();
 
 public slots:
@@ -76,12 +81,33 @@ private:
 
     CheckBoxDelegate* checkBoxDelegate;
 
-    mutable std::recursive_mutex fileIconMutex;
-
     FileViewType fileViewType;
 
     QString currentPath;
 
+    // 缩略图按需加载: 只解码可见区域及预取范围内的行
+    QTimer _thumbnailTimer;
+
+    // 目录切换时递增, 旧目录的结果直接丢弃
+    int _thumbnailGeneration;
+
+    // 预取的行数(缩略图行, 非model行)
+    int _prefetchRows;
+
+    // 缩略图网格档位, Ctrl+滚轮切换
+    int _thumbnailTier;
+
+    void setThumbnailTier(int tier);
+
+    // source row -> 取消标志
+    QHash<int, DecodeTicket> _pendingThumbnails;
+
+    void cancelThumbnails();
+
+    void requestVisibleThumbnails();
+
+    void onThumbnailLoaded(int generation, int sourceRow, ImageReadDataPtr image);
+
     // widget init
     void initListView();
 
@@ -101,9 +127,33 @@ private:
 
     void onCurrentChanged(const QModelIndex& current, const QModelIndex& previous);
 
-    QList<QFileInfo> getRowItemList(const QString& currentDirPath);
+    // 后台目录枚举
+    DirectoryEnumerator* _enumerator;
+
+    quint64 _enumStart;
+
+    void onEntriesReady(const QList<DirEntry>& entries);
+
+    void onEnumerationFinished(const QString& path, int count);
+
+    // 监视当前目录, 变化合并后增量更新模型
+    QFileSystemWatcher* _watcher;
+
+    QTimer _rescanTimer;
+
+    // 正在枚举, 期间的变化等枚举完成后再处理
+    bool _enumerating;
+
+    bool _rescanPending;
+
+    void onDirectoryChanged();
+
+    void rescanDirectory();
+
+    void onDirectoryContentChanged(const QString& path, const DirChanges& changes);
 
-    QList<QStandardItem*> getRowItemList();
+    // 监视可见范围(代理模型行号)内的图片文件, 内容被覆盖时触发重新枚举
+    void watchVisibleFiles(int first, int last);
 
 
     int _sortColumn;
@@ -8,9 +8,21 @@
 #include <QGuiApplication>
 #include <QScreen>
 #include <QMimeDatabase>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <QThread>
+#include <QCoreApplication>
+#include <QPointer>
 
 #include "logger/Logger.h"
 #include "util/fasthash.h"
+#include "util/xorkernel.h"
+#include "util/imagetransform.h"
+#include "util/imagefiletype.h"
+#include "cache/thumbnailstore.h"
+#include "cache/imagereaddatacache.h"
+#include "config.h"
 
 ImageCore::ImageCore(QObject* parent) : QObject(parent)
 {
@@ -18,20 +30,32 @@ ImageCore::ImageCore(QObject* parent) : QObject(parent)
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     QImageReader::setAllocationLimit(8192);
 #endif
-    _imageReadDataCache = new QCache<uint64_t, ImageReadData>(5000);
-
-    _mineDb = new QMimeDatabase;
-
-    connect(&loadFutureWatcher, &QFutureWatcher<ImageReadData>::finished, this, [this]() {
-        loadPixmap(loadFutureWatcher.result());
-        });
+    // 内存缓存预算, 单位MiB
+    const int thumbnailCacheMB = ConfigIni::getInstance().iniRead(QStringLiteral("Cache/thumbnailCacheMB"), 64).toInt();
+    const int previewCacheMB = ConfigIni::getInstance().iniRead(QStringLiteral("Cache/previewCacheMB"), 64).toInt();
+    const int fullCacheMB = ConfigIni::getInstance().iniRead(QStringLiteral("Cache/fullCacheMB"), 512).toInt();
+    _imageReadDataCache[ThumbnailTier] = new ImageReadDataCache(qMax(thumbnailCacheMB, 1) * 1024);
+    _imageReadDataCache[PreviewTier] = new ImageReadDataCache(qMax(previewCacheMB, 1) * 1024);
+    _imageReadDataCache[FullTier] = new ImageReadDataCache(qMax(fullCacheMB, 1) * 1024);
+
+    const qint64 storeMB = ConfigIni::getInstance().iniRead(QStringLiteral("Cache/thumbnailStoreMB"), 512).toLongLong();
+    _thumbnailStore = new ThumbnailStore(QDir(ConfigIni::getInstance().iniDir()).filePath(QStringLiteral("WeImages.thumbs")),
+        qMax<qint64>(storeMB, 16) * 1024 * 1024);
+
+    const int decodeThreads = ConfigIni::getInstance().iniRead(QStringLiteral("Decode/threads"), QThread::idealThreadCount()).toInt();
+    _decodePool.setMaxThreadCount(qMax(1, decodeThreads));
 }
 
 ImageCore::~ImageCore()
 {
-    delete _mineDb;
-    _imageReadDataCache->clear();
-    delete _imageReadDataCache;
+    _decodePool.clear();
+    _decodePool.waitForDone();
+    delete _thumbnailStore;
+    for (auto cache : _imageReadDataCache)
+    {
+        cache->clear();
+        delete cache;
+    }
 }
 
 void ImageCore::loadFile(const QString& fileName, const QSize& targetSize)
@@ -47,34 +71,123 @@ void ImageCore::loadFile(const QString& fileName, const QSize& targetSize)
     sanitaryFileName = fileInfo.absoluteFilePath();
 
     uint64_t hash = 0;
-    if (findImageReadData(hash, fileName, targetSize))
+    ImageReadDataPtr readData = findImageReadData(hash, sanitaryFileName, targetSize);
+    if (!readData.isNull())
     {
-        ImageReadData* readData = this->getImageReadData(hash);
         loadPixmap(readData);
     }
     else
     {
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-        loadFutureWatcher.setFuture(QtConcurrent::run(this, &ImageCore::readFile, fileInfo.absoluteFilePath(), targetSize));
-#else
-        loadFutureWatcher.setFuture(QtConcurrent::run(&ImageCore::readFile, this, fileInfo.absoluteFilePath(), targetSize));
-#endif
+        // 新的预览请求取代旧的
+        if (!_previewTicket.isNull())
+        {
+            *_previewTicket = true;
+        }
+        _previewTicket = decode(sanitaryFileName, targetSize, PreviewPriority, this, [this](ImageReadDataPtr readData) {
+            loadPixmap(readData);
+            });
     }
 }
 
-ImageReadData* ImageCore::readFile(const QString& fileName, const QSize& targetSize)
+DecodeTicket ImageCore::decode(const QString& fileName, const QSize& targetSize, DecodePriority priority,
+    QObject* receiver, std::function<void(ImageReadDataPtr)> onLoaded)
+{
+    DecodeTicket cancelled = DecodeTicket::create(false);
+    // 查看器任务不随目录切换失效
+    const int generation = priority >= ViewerPrefetchPriority ? -1 : _generation.loadRelaxed();
+    QPointer<QObject> target(receiver);
+    _decodePool.start([this, fileName, targetSize, generation, cancelled, target, onLoaded]() {
+        if (*cancelled || (generation >= 0 && generation != _generation.loadRelaxed()))
+        {
+            return;
+        }
+        ImageReadDataPtr readData = readFile(fileName, targetSize);
+        if (*cancelled)
+        {
+            return;
+        }
+        QMetaObject::invokeMethod(this, [cancelled, target, onLoaded, readData]() {
+            if (!*cancelled && !target.isNull())
+            {
+                onLoaded(readData);
+            }
+            }, Qt::QueuedConnection);
+        }, priority);
+    return cancelled;
+}
+
+void ImageCore::newGeneration()
+{
+    _generation.fetchAndAddRelaxed(1);
+}
+
+ImageReadDataPtr ImageCore::cachedImage(const QString& fileName, const QSize& targetSize)
 {
     uint64_t hash = 0;
-    if (findImageReadData(hash, fileName, targetSize))
+    return findImageReadData(hash, fileName, targetSize);
+}
+
+bool ImageCore::thumbnailStoreReadOnly() const
+{
+    return _thumbnailStore->isReadOnly();
+}
+
+void ImageCore::invalidateFile(const QString& fileName)
+{
+    uint64_t hash = 0;
+    for (int tier = 0; tier <= THUMBNAIL_TIER_COUNT; ++tier)
+    {
+        // 最后一次为原图尺寸
+        const QSize targetSize = tier < THUMBNAIL_TIER_COUNT ? thumbnailTierSize(tier) : QSize();
+        if (!findImageReadData(hash, fileName, targetSize).isNull())
+        {
+            this->_imageReadDataCache[cacheTier(targetSize)]->remove(hash);
+        }
+    }
+}
+
+ImageReadDataPtr ImageCore::readFile(const QString& fileName, const QSize& targetSize)
+{
+    uint64_t hash = 0;
+    ImageReadDataPtr cached = findImageReadData(hash, fileName, targetSize);
+    if (!cached.isNull())
     {
-        ImageReadData* readData = this->getImageReadData(hash);
-        return readData;
+        return cached;
     }
 
     QPixmap readPixmap;
     QFileInfo fileInfo(fileName);
     QString extension = fileInfo.suffix();
-    if (this->isWeChatImage(fileInfo)) {
+
+    uint64_t storeKey = 0;
+    const bool thumbnail = isThumbnailSize(targetSize);
+    bool storeHit = false;
+    if (thumbnail)
+    {
+        QImage storeImage;
+        storeKey = ThumbnailStore::key(fileInfo, targetSize);
+        if (_thumbnailStore->find(storeKey, storeImage))
+        {
+            readPixmap = QPixmap::fromImage(std::move(storeImage));
+            storeHit = !readPixmap.isNull();
+        }
+    }
+
+    const int tier = thumbnail ? thumbnailTier(targetSize) : -1;
+    QImage larger;
+    if (storeHit) {
+        // 命中持久化缓存
+    }
+    else if (tier >= 0 && findLargerTier(fileName, fileInfo, tier, larger, extension)) {
+        // 由已缓存的大档缩略图盒式缩小, 不解码
+        const QSize fitted = larger.size().scaled(targetSize, Qt::KeepAspectRatio)
+            .boundedTo(larger.size()).expandedTo(QSize(1, 1));
+        readPixmap = QPixmap::fromImage(boxDownsample(larger, fitted));
+    }
+    else if (targetSize.isValid() && readExifThumbnail(fileInfo, targetSize, readPixmap)) {
+        // 内嵌的EXIF缩略图足够大, 不解码整张图
+    }
+    else if (this->isWeChatImage(fileInfo)) {
         // wechat picture
         readPixmap = readWeImage(fileName, fileInfo.size(), extension, targetSize);
         LOG_INFO << "readWeImage extension: " << extension;
@@ -85,11 +198,6 @@ ImageReadData* ImageCore::readFile(const QString& fileName, const QSize& targetS
         imageReader.setAutoTransform(true);
 
         imageReader.setFileName(fileName);
-        if (targetSize.isValid())
-        {
-            auto targetScaledSize = imageReader.size().scaled(targetSize, Qt::KeepAspectRatio);
-            imageReader.setScaledSize(targetSize);
-        }
 
         //if (imageReader.format() == "svg" || imageReader.format() == "svgz")
         //{
@@ -103,69 +211,518 @@ ImageReadData* ImageCore::readFile(const QString& fileName, const QSize& targetS
         //}
         //else
         //{
-            readPixmap = QPixmap::fromImageReader(&imageReader);
+            readPixmap = QPixmap::fromImage(readScaled(imageReader, targetSize));
         //}
     }
 
-    ImageReadData* readData = new ImageReadData{
+    if (thumbnail && !storeHit && !readPixmap.isNull())
+    {
+        _thumbnailStore->insert(storeKey, readPixmap.toImage());
+    }
+
+    ImageReadDataPtr readData(new ImageReadData{
         readPixmap,
         fileInfo,
         extension,
         hash
-    };
-    addToCache(*readData);
+    });
+    addToCache(readData, targetSize);
     return readData;
 }
 
 QPixmap ImageCore::readWeImage(const QString& fileName, long long fileSize, QString& extension, const QSize& targetSize)
 {
     QPixmap readPixmap;
-    BYTE* imageData = datConverImage(fileName, fileSize, &extension);
-    DWORD start = GetTickCount();
-    if (readPixmap.loadFromData(imageData, fileSize)) {
-        if (!readPixmap.isNull() && targetSize.isValid())
+    QByteArray imageData;
+    if (!datConverImage(fileName, imageData, &extension))
+    {
+        return readPixmap;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    QBuffer buffer(&imageData);
+    QImageReader imageReader(&buffer, extension.toLatin1());
+    QImage image = readScaled(imageReader, targetSize);
+    if (!image.isNull()) {
+        readPixmap = QPixmap::fromImage(std::move(image));
+    }
+    LOG_INFO << "loadFromData time: " << timer.elapsed();
+    return readPixmap;
+}
+
+QImage ImageCore::readScaled(QImageReader& imageReader, const QSize& targetSize)
+{
+    if (!targetSize.isValid())
+    {
+        return imageReader.read();
+    }
+
+    // size() 只读文件头
+    QSize sourceSize = imageReader.size();
+    if (!sourceSize.isValid())
+    {
+        QImage image = imageReader.read();
+        if (image.isNull() || (image.width() <= targetSize.width() && image.height() <= targetSize.height()))
         {
-            readPixmap = readPixmap.scaled(targetSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            return image;
         }
+        return image.scaled(targetSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
-    LOG_INFO << "loadFromData time: " << GetTickCount() - start;
-    delete[] imageData;
-    return readPixmap;
+
+    // 自动旋转90度的图片, 文件中的宽高与显示相反
+    QSize boundSize = targetSize;
+    if (imageReader.autoTransform() && imageReader.transformation().testFlag(QImageIOHandler::TransformationRotate90))
+    {
+        boundSize.transpose();
+    }
+    if (sourceSize.width() <= boundSize.width() && sourceSize.height() <= boundSize.height())
+    {
+        // 不放大
+        return imageReader.read();
+    }
+    const QSize scaledSize = sourceSize.scaled(boundSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+
+    if (imageReader.format() == "jpeg" || imageReader.format() == "jpg")
+    {
+        // JPEG 解码时按 DCT 缩放(1/2, 1/4, 1/8), 取不小于目标的最小尺寸,
+        // 再对这个小的中间图做一次平滑缩放
+        int denom = 8;
+        while (denom > 1 && (sourceSize.width() / denom < scaledSize.width() || sourceSize.height() / denom < scaledSize.height()))
+        {
+            denom /= 2;
+        }
+        const QSize decodeSize((sourceSize.width() + denom - 1) / denom, (sourceSize.height() + denom - 1) / denom);
+        imageReader.setScaledSize(decodeSize);
+        QImage image = imageReader.read();
+        if (image.isNull() || image.size() == scaledSize || image.size() == scaledSize.transposed())
+        {
+            return image;
+        }
+        return image.scaled(image.size().scaled(targetSize, Qt::KeepAspectRatio), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    // 其它格式交给插件, 支持 ScaledSize 的插件(svg等)直接按目标尺寸解码
+    imageReader.setScaledSize(scaledSize);
+    return imageReader.read();
 }
 
-void ImageCore::loadPixmap(const ImageReadData* readData)
+void ImageCore::loadPixmap(const ImageReadDataPtr& readData)
 {
-    if (readData->pixmap.isNull())
+    if (readData.isNull() || readData->pixmap.isNull())
         return;
-    emit imageLoaded((ImageReadData*)readData);
+    emit imageLoaded(readData);
 }
 
-void ImageCore::addToCache(const ImageReadData &readData)
+void ImageCore::addToCache(const ImageReadDataPtr& readData, const QSize& targetSize)
 {
     //QString key = readData.fileInfo.absoluteFilePath().append("_%1x%2").arg(readData.pixmap.width()).arg(readData.pixmap.height());
     //LOG_INFO << "addToCache key: " << key;
     //QPixmapCache::insert(key, readData.pixmap);
-   
-    this->_imageReadDataCache->insert(readData.hash, const_cast<ImageReadData*>(&readData));
+
+    const qint64 bytes = static_cast<qint64>(readData->pixmap.width()) * readData->pixmap.height() * readData->pixmap.depth() / 8;
+    this->_imageReadDataCache[cacheTier(targetSize)]->insert(readData->hash, readData, static_cast<qsizetype>(bytes / 1024));
 }
 
 bool ImageCore::isImageFile(const QFileInfo& fileInfo)
 {
-    if (isWeChatImage(fileInfo))
+    return classifyImageFile(fileInfo);
+}
+
+bool ImageCore::isWeChatImage(const QFileInfo& fileInfo)
+{
+    //LOG_INFO << "isWeChatImage suffix:" << fileInfo.suffix() << " baseName: " << fileInfo.baseName();
+    return isWeChatImageFile(fileInfo);
+}
+
+// 读取并还原文件中的一段字节
+static bool readXorBytes(QFile& file, qint64 pos, uchar* buf, qint64 len, uchar byXOR)
+{
+    if (!file.seek(pos) || file.read(reinterpret_cast<char*>(buf), len) != len)
     {
-        // wechat picture
+        return false;
+    }
+    xorBuffer(buf, buf, static_cast<size_t>(len), byXOR);
+    return true;
+}
+
+static bool isJpegSofMarker(uchar marker)
+{
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+// 沿JPEG段链查找SOF, 只读取每个段的段头
+static QSize probeJpegSize(QFile& file, uchar byXOR)
+{
+    uchar seg[9];
+    qint64 pos = 2;
+    const qint64 fileSize = file.size();
+    while (pos + 4 <= fileSize)
+    {
+        if (!readXorBytes(file, pos, seg, 4, byXOR) || seg[0] != 0xFF)
+            break;
+        const uchar marker = seg[1];
+        if (marker == 0xFF)
+        {
+            // 填充字节
+            pos += 1;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+        {
+            pos += 2;
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA)
+            break;
+        if (isJpegSofMarker(marker))
+        {
+            if (!readXorBytes(file, pos + 4, seg + 4, 5, byXOR))
+                break;
+            const int height = (seg[5] << 8) | seg[6];
+            const int width = (seg[7] << 8) | seg[8];
+            return QSize(width, height);
+        }
+        pos += 2 + ((seg[2] << 8) | seg[3]);
+    }
+    return QSize();
+}
+
+static quint16 exifRead16(const uchar* p, bool bigEndian)
+{
+    return bigEndian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+}
+
+static quint32 exifRead32(const uchar* p, bool bigEndian)
+{
+    return bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+}
+
+// 解析APP1中的TIFF结构, 取得方向(IFD0 0x0112)和缩略图位置(IFD1 0x0201/0x0202)
+static bool parseExifThumbnail(const QByteArray& tiff, int& orientation, QByteArray& thumbnail)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(tiff.constData());
+    const quint32 size = static_cast<quint32>(tiff.size());
+    if (size < 8 || !((data[0] == 'I' && data[1] == 'I') || (data[0] == 'M' && data[1] == 'M')))
+        return false;
+    const bool bigEndian = data[0] == 'M';
+    if (exifRead16(data + 2, bigEndian) != 42)
+        return false;
+
+    quint32 ifd = exifRead32(data + 4, bigEndian);
+    quint32 thumbOffset = 0;
+    quint32 thumbLength = 0;
+    for (int ifdIndex = 0; ifdIndex < 2; ++ifdIndex)
+    {
+        if (ifd == 0 || ifd + 2 > size)
+            return false;
+        const quint16 count = exifRead16(data + ifd, bigEndian);
+        if (ifd + 2 + count * 12u + 4 > size)
+            return false;
+        for (quint16 i = 0; i < count; ++i)
+        {
+            const uchar* entry = data + ifd + 2 + i * 12;
+            const quint16 tag = exifRead16(entry, bigEndian);
+            if (ifdIndex == 0 && tag == 0x0112)
+                orientation = exifRead16(entry + 8, bigEndian);
+            else if (ifdIndex == 1 && tag == 0x0201)
+                thumbOffset = exifRead32(entry + 8, bigEndian);
+            else if (ifdIndex == 1 && tag == 0x0202)
+                thumbLength = exifRead32(entry + 8, bigEndian);
+        }
+        ifd = exifRead32(data + ifd + 2 + count * 12, bigEndian);
+    }
+    if (thumbLength == 0 || thumbOffset == 0 || thumbOffset > size || thumbLength > size - thumbOffset)
+        return false;
+    thumbnail = tiff.mid(thumbOffset, thumbLength);
+    return true;
+}
+
+// 沿JPEG段链读取APP1(Exif)和SOF, 不读取图像数据
+static bool readJpegExif(QFile& file, uchar byXOR, QByteArray& tiff, QSize& mainSize)
+{
+    uchar seg[9];
+    qint64 pos = 2;
+    const qint64 fileSize = file.size();
+    while (pos + 4 <= fileSize)
+    {
+        if (!readXorBytes(file, pos, seg, 4, byXOR) || seg[0] != 0xFF)
+            break;
+        const uchar marker = seg[1];
+        if (marker == 0xFF)
+        {
+            pos += 1;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+        {
+            pos += 2;
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA)
+            break;
+        const int length = (seg[2] << 8) | seg[3];
+        if (marker == 0xE1 && tiff.isEmpty() && length > 8)
+        {
+            QByteArray app1(length - 2, Qt::Uninitialized);
+            if (!readXorBytes(file, pos + 4, reinterpret_cast<uchar*>(app1.data()), app1.size(), byXOR))
+                break;
+            if (app1.startsWith(QByteArrayLiteral("Exif\0\0")))
+                tiff = app1.mid(6);
+        }
+        else if (isJpegSofMarker(marker))
+        {
+            if (readXorBytes(file, pos + 4, seg + 4, 5, byXOR))
+                mainSize = QSize((seg[7] << 8) | seg[8], (seg[5] << 8) | seg[6]);
+            return !tiff.isEmpty();
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+// EXIF 方向值 1-8 对应的 2x2 变换矩阵 {a, b, c, d} = [[a, b], [c, d]], 作用于列向量(x, y), y 向下
+// 与 QImageIOHandler::Transformations 一致: 先镜像/翻转, 再顺时针旋转90度
+static const int EXIF_ORIENTATION_MATRIX[9][4] = {
+    { 1, 0, 0, 1 }, { 1, 0, 0, 1 }, { -1, 0, 0, 1 }, { -1, 0, 0, -1 }, { 1, 0, 0, -1 },
+    { 0, 1, 1, 0 }, { 0, -1, 1, 0 }, { 0, -1, -1, 0 }, { 0, 1, -1, 0 } };
+
+// 原方向显示后再做 transform, 得到新的 EXIF 方向值, transform 不是90度倍数时返回0
+static int composeExifOrientation(int orientation, const QTransform& transform)
+{
+    const int* t = EXIF_ORIENTATION_MATRIX[(orientation >= 1 && orientation <= 8) ? orientation : 1];
+    // QTransform 把 (x, y) 映射为 (m11 x + m21 y, m12 x + m22 y)
+    const int a = qRound(transform.m11()), b = qRound(transform.m21());
+    const int c = qRound(transform.m12()), d = qRound(transform.m22());
+    const int r[4] = { a * t[0] + b * t[2], a * t[1] + b * t[3], c * t[0] + d * t[2], c * t[1] + d * t[3] };
+    for (int i = 1; i <= 8; ++i)
+    {
+        const int* m = EXIF_ORIENTATION_MATRIX[i];
+        if (m[0] == r[0] && m[1] == r[1] && m[2] == r[2] && m[3] == r[3])
+            return i;
+    }
+    return 0;
+}
+
+// 在已还原的 JPEG 文件头中写入方向, 不改动像素数据(无损)
+// 已有方向标签时原地修改; 没有 Exif 段时生成一个只含方向的 APP1, 由调用者在 insertPos 处插入
+// data 只是文件开头的一块: 段链在块内没有走到 SOF/SOS, 或 APP1 超出块尾时无法判断, 返回false
+static bool orientJpegHeader(uchar* data, qint64 size, const QTransform& transform, QByteArray& segment, qint64& insertPos)
+{
+    segment.clear();
+    insertPos = 2;
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+    qint64 pos = 2;
+    bool exifFound = false;
+    bool headerEnd = false;
+    while (pos + 4 <= size && data[pos] == 0xFF)
+    {
+        const uchar marker = data[pos + 1];
+        if (marker == 0xD9 || marker == 0xDA || isJpegSofMarker(marker))
+        {
+            headerEnd = true;
+            break;
+        }
+        const qint64 length = (data[pos + 2] << 8) | data[pos + 3];
+        if (marker == 0xE1 && pos + 2 + length > size)
+        {
+            // APP1 比一块还大, 其中可能有方向标签, 不能再插入一个 Exif 段
+            return false;
+        }
+        // JFIF 要求 APP0 紧跟 SOI, 新的 APP1 放在它后面
+        if (marker == 0xE0 && pos == 2)
+            insertPos = pos + 2 + length;
+        if (marker == 0xE1 && length > 16 && pos + 2 + length <= size && memcmp(data + pos + 4, "Exif\0\0", 6) == 0)
+        {
+            exifFound = true;
+            uchar* tiff = data + pos + 10;
+            const quint32 tiffSize = quint32(length - 8);
+            const bool bigEndian = tiff[0] == 'M';
+            const quint32 ifd = exifRead32(tiff + 4, bigEndian);
+            if (ifd + 2 > tiffSize)
+                return false;
+            const quint16 count = exifRead16(tiff + ifd, bigEndian);
+            for (quint16 i = 0; i < count && ifd + 2 + (i + 1) * 12u <= tiffSize; ++i)
+            {
+                uchar* entry = tiff + ifd + 2 + i * 12;
+                if (exifRead16(entry, bigEndian) != 0x0112)
+                    continue;
+                const int orientation = composeExifOrientation(exifRead16(entry + 8, bigEndian), transform);
+                if (orientation == 0)
+                    return false;
+                if (bigEndian)
+                    qToBigEndian<quint16>(quint16(orientation), entry + 8);
+                else
+                    qToLittleEndian<quint16>(quint16(orientation), entry + 8);
+                return true;
+            }
+            break;
+        }
+        pos += 2 + length;
+    }
+    // 有 Exif 但没有方向标签时不再插入第二个 Exif 段; 段链在块尾截断时后面可能还有 Exif
+    if (exifFound || !headerEnd)
+        return false;
+    const int orientation = composeExifOrientation(1, transform);
+    if (orientation == 0)
+        return false;
+    if (orientation == 1)
         return true;
+    // APP1: 长度 + "Exif\0\0" + 大端 TIFF 头 + IFD0(1项: 方向) + 下一个IFD偏移0
+    static const uchar app1[36] = {
+        0xFF, 0xE1, 0x00, 0x22, 'E', 'x', 'i', 'f', 0x00, 0x00,
+        'M', 'M', 0x00, 0x2A, 0x00, 0x00, 0x00, 0x08,
+        0x00, 0x01, 0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00 };
+    segment = QByteArray(reinterpret_cast<const char*>(app1), sizeof(app1));
+    segment[29] = char(orientation);
+    insertPos = qMin(insertPos, size);
+    return true;
+}
+
+// EXIF 方向 -> 显示方向
+static QImage exifOriented(const QImage& image, int orientation)
+{
+    switch (orientation)
+    {
+    case 2: return mirrorImage(image, true);
+    case 3: return rotateImage180(image);
+    case 4: return mirrorImage(image, false);
+    case 5: return mirrorImage(rotateImage90(image, true), true);
+    case 6: return rotateImage90(image, true);
+    case 7: return mirrorImage(rotateImage90(image, true), false);
+    case 8: return rotateImage90(image, false);
+    default: return image;
     }
-    
-    QMimeType mime = _mineDb->mimeTypeForFile(fileInfo);
-    
-    return mime.name().startsWith("image/");
 }
 
-bool ImageCore::isWeChatImage(const QFileInfo& fileInfo)
+bool ImageCore::readExifThumbnail(const QFileInfo& fileInfo, const QSize& targetSize, QPixmap& pixmap)
 {
-    //LOG_INFO << "isWeChatImage suffix:" << fileInfo.suffix() << " baseName: " << fileInfo.baseName();
-    return fileInfo.suffix() == "dat" && fileInfo.baseName().length() == 32;
+    QFile file(fileInfo.absoluteFilePath());
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    uchar head[2];
+    if (file.read(reinterpret_cast<char*>(head), 2) != 2)
+    {
+        return false;
+    }
+    uchar byXOR = 0;
+    if (isWeChatImage(fileInfo))
+    {
+        QString extension;
+        if (!datXorKey(head, &extension, byXOR) || extension != "jpg")
+            return false;
+    }
+    else if (head[0] != 0xFF || head[1] != 0xD8)
+    {
+        return false;
+    }
+
+    QByteArray tiff;
+    QSize mainSize;
+    if (!readJpegExif(file, byXOR, tiff, mainSize) || !mainSize.isValid())
+    {
+        return false;
+    }
+    int orientation = 1;
+    QByteArray thumbnailData;
+    QImage thumbnail;
+    if (!parseExifThumbnail(tiff, orientation, thumbnailData) || !thumbnail.loadFromData(thumbnailData, "jpg"))
+    {
+        return false;
+    }
+
+    // 很多相机的缩略图固定为160x120并加黑边, 宽高比与原图不一致时不用
+    const double mainRatio = double(mainSize.width()) / mainSize.height();
+    const double thumbRatio = double(thumbnail.width()) / thumbnail.height();
+    if (qAbs(mainRatio - thumbRatio) > mainRatio * 0.02)
+    {
+        return false;
+    }
+
+    thumbnail = exifOriented(thumbnail, orientation);
+    // 缩略图比目标小时需要解码原图
+    const QSize scaledSize = thumbnail.size().scaled(targetSize, Qt::KeepAspectRatio);
+    if (thumbnail.width() < scaledSize.width() || thumbnail.height() < scaledSize.height())
+    {
+        return false;
+    }
+    pixmap = QPixmap::fromImage(thumbnail.size() == scaledSize ? thumbnail
+        : thumbnail.scaled(scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    return true;
+}
+
+bool ImageCore::probeImage(const QFileInfo& fileInfo, ImageProbeData& probe)
+{
+    QFile file(fileInfo.absoluteFilePath());
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    uchar head[26];
+    if (file.read(reinterpret_cast<char*>(head), 2) != 2)
+    {
+        return false;
+    }
+
+    probe = ImageProbeData();
+    if (isWeChatImage(fileInfo))
+    {
+        if (!datXorKey(head, &probe.format, probe.xorKey))
+        {
+            return false;
+        }
+    }
+    else if (head[0] == 0xFF && head[1] == 0xD8)
+    {
+        probe.format = "jpg";
+    }
+    else if (head[0] == 0x89 && head[1] == 0x50)
+    {
+        probe.format = "png";
+    }
+    else if (head[0] == 0x47 && head[1] == 0x49)
+    {
+        probe.format = "gif";
+    }
+    else
+    {
+        // 其它格式交给对应的图片插件读取文件头
+        file.close();
+        QImageReader imageReader(fileInfo.absoluteFilePath());
+        imageReader.setDecideFormatFromContent(true);
+        if (!imageReader.canRead())
+        {
+            return false;
+        }
+        probe.format = QString::fromLatin1(imageReader.format());
+        probe.size = imageReader.size();
+        return true;
+    }
+
+    if (probe.format == "jpg")
+    {
+        probe.size = probeJpegSize(file, probe.xorKey);
+    }
+    else if (probe.format == "png")
+    {
+        // 8字节签名 + IHDR长度(4) + "IHDR"(4) + 宽(4) + 高(4), 大端
+        if (readXorBytes(file, 0, head, 24, probe.xorKey) && memcmp(head + 12, "IHDR", 4) == 0)
+        {
+            probe.size = QSize(qFromBigEndian<quint32>(head + 16), qFromBigEndian<quint32>(head + 20));
+        }
+    }
+    else if (probe.format == "gif")
+    {
+        // "GIF89a" + 宽(2) + 高(2), 小端
+        if (readXorBytes(file, 0, head, 10, probe.xorKey))
+        {
+            probe.size = QSize(qFromLittleEndian<quint16>(head + 6), qFromLittleEndian<quint16>(head + 8));
+        }
+    }
+    return true;
 }
 
 QPixmap ImageCore::scaled(const QPixmap& originPixmap, const QSize& targetSize)
@@ -175,43 +732,87 @@ QPixmap ImageCore::scaled(const QPixmap& originPixmap, const QSize& targetSize)
 
 QPixmap ImageCore::flipImage(const QPixmap originPixmap, bool horizontal /*= true*/, int dir /*= 1*/)
 {
-    float  width = originPixmap.width(), height = originPixmap.height();
-    return originPixmap.transformed(QTransform()
-        .translate(-width / 2, -height / 2)
-        .rotate(horizontal ? 180.0 * dir : -180.0 * dir, horizontal ? Qt::YAxis : Qt::XAxis)
-        .translate(width / 2, height / 2), Qt::TransformationMode::SmoothTransformation);
+    // 翻转两次等于原图, 与方向无关; 按像素搬移, 不重采样
+    Q_UNUSED(dir);
+    return QPixmap::fromImage(mirrorImage(originPixmap.toImage(), horizontal));
 }
 
 QPixmap ImageCore::rotateImage(const QPixmap& originPixmap, bool right /*= true*/, int dir /*= 1*/)
 {
-    float  width = originPixmap.width(), height = originPixmap.height();
-    return originPixmap.transformed(QTransform()
-        .translate(-width / 2, -height / 2)
-        .rotate(right ? 90.0 * dir : -90.0 * dir)
-        .translate(width / 2, height / 2), Qt::TransformationMode::SmoothTransformation);
+    return QPixmap::fromImage(rotateImage90(originPixmap.toImage(), right == (dir > 0)));
 }
 
-int ImageCore::exportWeChatImage(const QFileInfo& soureFile, const QString& targetPath)
+int ImageCore::exportWeChatImage(const QFileInfo& soureFile, const QString& targetPath, const QTransform& transform)
 {
     int ret = 1;
     if (!isWeChatImage(soureFile))
     {
         return ret;
     }
+    QFile rf(soureFile.absoluteFilePath());
+    if (!rf.open(QIODevice::ReadOnly))
+    {
+        return ret;
+    }
+
+    // 固定大小缓冲区分块读取->异或->写入, 峰值内存与文件大小无关
+    QByteArray chunk(EXPORT_CHUNK_SIZE, Qt::Uninitialized);
+    uchar* buf = reinterpret_cast<uchar*>(chunk.data());
+    qint64 readLen = rf.read(chunk.data(), chunk.size());
+
     QString extension = soureFile.suffix();
-    BYTE* imageData = datConverImage(soureFile.absoluteFilePath(), soureFile.size(), &extension);
+    uchar byXOR = 0;
+    if (readLen < 2 || !datXorKey(buf, &extension, byXOR))
+    {
+        return ret;
+    }
+
     QFile wf(targetPath + QDir::separator() + soureFile.baseName() + "." + extension);
-    if (wf.open(QIODevice::WriteOnly))
+    if (!wf.open(QIODevice::WriteOnly))
     {
-        QDataStream out(&wf);
-        out.writeRawData((const char *)imageData, soureFile.size());
-        wf.close();
-        ret = 0;
+        return 2;
     }
-    else {
+    wf.resize(rf.size());
+
+    ret = 0;
+    if (!transform.isIdentity() && extension == QStringLiteral("jpg"))
+    {
+        // 旋转只改写文件头中的 EXIF 方向, 像素数据原样写出
+        xorBuffer(buf, buf, static_cast<size_t>(readLen), byXOR);
+        QByteArray segment;
+        qint64 insertPos = 0;
+        if (!orientJpegHeader(buf, readLen, transform, segment, insertPos))
+        {
+            LOG_WARN << "export without orientation: " << soureFile.absoluteFilePath();
+            insertPos = 0;
+        }
+        if (wf.write(chunk.constData(), insertPos) != insertPos
+            || wf.write(segment) != segment.size()
+            || wf.write(chunk.constData() + insertPos, readLen - insertPos) != readLen - insertPos)
+        {
+            ret = 2;
+        }
+        readLen = ret == 0 ? rf.read(chunk.data(), chunk.size()) : 0;
+    }
+    while (ret == 0 && readLen > 0)
+    {
+        xorBuffer(buf, buf, static_cast<size_t>(readLen), byXOR);
+        if (wf.write(chunk.constData(), readLen) != readLen)
+        {
+            ret = 2;
+            break;
+        }
+        readLen = rf.read(chunk.data(), chunk.size());
+    }
+    if (readLen < 0)
+    {
         ret = 2;
     }
-    delete imageData;
+    wf.close();
+    if (ret != 0)
+    {
+        wf.remove();
+    }
     return ret;
 }
 
@@ -234,106 +835,149 @@ QStringList ImageCore::imageNames()
     return names;
 }
 
-BYTE* ImageCore::datConverImage(const QString &datFileName, long long fileSize, QString* extension) {
-    BYTE byJPG1 = 0xFF;
-    BYTE byJPG2 = 0xD8;
-    BYTE byGIF1 = 0x47;
-    BYTE byGIF2 = 0x49;
-    BYTE byPNG1 = 0x89;
-    BYTE byPNG2 = 0x50;
+bool ImageCore::datConverImage(const QString& datFileName, QByteArray& imageData, QString* extension)
+{
+    QFile datFile(datFileName);
+    if (!datFile.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    const qint64 fileSize = datFile.size();
+    if (fileSize < 2)
+    {
+        return false;
+    }
 
-    HANDLE hDatFile = INVALID_HANDLE_VALUE;
+    // mmap on linux, file mapping on windows, the mapping stays valid after close
+    const uchar* datBuf = datFile.map(0, fileSize);
+    if (nullptr == datBuf)
+    {
+        return false;
+    }
 
-    BYTE* datBuf = new BYTE[fileSize];
-    BYTE* tmpBuf = new BYTE[64 * 1024];
-    do
+    uchar byXOR = 0;
+    if (!datXorKey(datBuf, extension, byXOR))
     {
-        hDatFile = CreateFile(datFileName.toStdWString().c_str(), GENERIC_READ, FILE_SHARE_WRITE | FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
-        if (INVALID_HANDLE_VALUE == hDatFile)
-            break;
+        datFile.unmap(const_cast<uchar*>(datBuf));
+        return false;
+    }
 
-        // 读取内容前2个字节
-        DWORD dwReadLen = 0;
-        BOOL bRet = ReadFile(hDatFile, tmpBuf, 2, &dwReadLen, NULL);
-        if (!bRet || 2 != dwReadLen)
-            break;
+    // 映射内存异或后直接写入输出缓冲, 每个字节只读写一次
+    imageData.resize(fileSize);
+    xorBuffer(reinterpret_cast<uchar*>(imageData.data()), datBuf, static_cast<size_t>(fileSize), byXOR);
+
+    datFile.unmap(const_cast<uchar*>(datBuf));
+    return true;
+}
 
-        // 开始异或判断
-        BYTE byJ1 = byJPG1 ^ tmpBuf[0];
-        BYTE byJ2 = byJPG2 ^ tmpBuf[1];
-        BYTE byG1 = byGIF1 ^ tmpBuf[0];
-        BYTE byG2 = byGIF2 ^ tmpBuf[1];
-        BYTE byP1 = byPNG1 ^ tmpBuf[0];
-        BYTE byP2 = byPNG2 ^ tmpBuf[1];
-
-        // 判断异或值
-        BYTE byXOR = 0;
-        if (byJ1 == byJ2)
+bool ImageCore::datXorKey(const uchar* head, QString* extension, uchar& byXOR)
+{
+    const uchar byJPG1 = 0xFF;
+    const uchar byJPG2 = 0xD8;
+    const uchar byGIF1 = 0x47;
+    const uchar byGIF2 = 0x49;
+    const uchar byPNG1 = 0x89;
+    const uchar byPNG2 = 0x50;
+
+    // 开始异或判断
+    const uchar byJ1 = byJPG1 ^ head[0];
+    const uchar byJ2 = byJPG2 ^ head[1];
+    const uchar byG1 = byGIF1 ^ head[0];
+    const uchar byG2 = byGIF2 ^ head[1];
+    const uchar byP1 = byPNG1 ^ head[0];
+    const uchar byP2 = byPNG2 ^ head[1];
+
+    // 判断异或值
+    if (byJ1 == byJ2)
+    {
+        byXOR = byJ1;
+        *extension = "jpg";
+    }
+    else if (byG1 == byG2)
+    {
+        byXOR = byG1;
+        *extension = "gif";
+    }
+    else if (byP1 == byP2)
+    {
+        byXOR = byP1;
+        *extension = "png";
+    }
+    else
+        return false;
+    return true;
+}
+
+QSize ImageCore::thumbnailTierSize(int tier)
+{
+    static const QSize sizes[THUMBNAIL_TIER_COUNT] = {
+        QSize(THUMBNAIL_WIDE / 2, THUMBNAIL_HEIGHT / 2),
+        QSize(THUMBNAIL_WIDE * 3 / 4, THUMBNAIL_HEIGHT * 3 / 4),
+        QSize(THUMBNAIL_WIDE, THUMBNAIL_HEIGHT),
+        QSize(THUMBNAIL_WIDE_N, THUMBNAIL_HEIGHT_N)
+    };
+    return sizes[qBound(0, tier, THUMBNAIL_TIER_COUNT - 1)];
+}
+
+int ImageCore::thumbnailTier(const QSize& targetSize)
+{
+    for (int tier = 0; tier < THUMBNAIL_TIER_COUNT; ++tier)
+    {
+        if (thumbnailTierSize(tier) == targetSize)
         {
-//            imageFile += ".jpg";
-            byXOR = byJ1;
-            *extension = "jpg";
+            return tier;
         }
-        else if (byG1 == byG2)
+    }
+    return -1;
+}
+
+bool ImageCore::findLargerTier(const QString& fileName, const QFileInfo& fileInfo, int tier, QImage& image, QString& extension)
+{
+    for (int larger = tier + 1; larger < THUMBNAIL_TIER_COUNT; ++larger)
+    {
+        const QSize largerSize = thumbnailTierSize(larger);
+        ImageReadDataPtr cached = cachedImage(fileName, largerSize);
+        if (!cached.isNull() && !cached->pixmap.isNull())
         {
-//            imageFile += ".gif";
-            byXOR = byG1;
-            *extension = "gif";
+            image = cached->pixmap.toImage();
+            extension = cached->suffix;
+            return true;
         }
-        else if (byP1 == byP2)
+        if (_thumbnailStore->find(ThumbnailStore::key(fileInfo, largerSize), image) && !image.isNull())
         {
-//            imageFile += ".png";
-            byXOR = byP1;
-            *extension = "png";
+            return true;
         }
-        else
-            break;
-
-        SetFilePointer(hDatFile, 0, NULL, FILE_BEGIN); // 设置到文件头开始
-
-        DWORD dwWriteLen = 0;
-        DWORD index = 0;
-        do
-        {
-            dwReadLen = 0;
-            bRet = ReadFile(hDatFile, tmpBuf, 64 * 1024, &dwReadLen, NULL);
-            if (!bRet)
-                break;
-
-            XOR(tmpBuf, dwReadLen, byXOR);
-
-            memcpy(datBuf + index, tmpBuf, dwReadLen);
-            index += dwReadLen;
-        } while (dwReadLen == 64*1024);
-    } while (FALSE);
+    }
+    return false;
+}
 
-    delete[] tmpBuf;
+bool ImageCore::isThumbnailSize(const QSize& targetSize)
+{
+    return thumbnailTier(targetSize) >= 0;
+}
 
-    if (INVALID_HANDLE_VALUE != hDatFile)
+ImageCacheTier ImageCore::cacheTier(const QSize& targetSize)
+{
+    if (!targetSize.isValid())
     {
-        CloseHandle(hDatFile);
-        hDatFile = INVALID_HANDLE_VALUE;
+        return FullTier;
     }
-    return datBuf;
-}
-
-void ImageCore::XOR(BYTE *v_pbyBuf, DWORD v_dwBufLen, BYTE byXOR) {
-    for (int i = 0; i < v_dwBufLen; i++)
+    if (targetSize.width() <= THUMBNAIL_WIDE && targetSize.height() <= THUMBNAIL_HEIGHT)
     {
-        v_pbyBuf[i] ^= byXOR;
+        return ThumbnailTier;
     }
+    if (targetSize.width() <= THUMBNAIL_WIDE_N && targetSize.height() <= THUMBNAIL_HEIGHT_N)
+    {
+        return PreviewTier;
+    }
+    return FullTier;
 }
 
-bool ImageCore::findImageReadData(uint64_t& hash, const QString& absoluteFilePath, const QSize& targetSize)
+ImageReadDataPtr ImageCore::findImageReadData(uint64_t& hash, const QString& absoluteFilePath, const QSize& targetSize)
 {
     QString key = absoluteFilePath;
     key = key.append("_%1x%2").arg(targetSize.width()).arg(targetSize.height());
     LOG_INFO << "findImageReadData key: " << key;
     hash = fasthash64(key.constData(), static_cast<uint64_t>(key.size()) * sizeof(QChar), 0);
-    return this->_imageReadDataCache->contains(hash);
-}
-
-ImageReadData* ImageCore::getImageReadData(uint64_t hash)
-{
-    return this->_imageReadDataCache->object(hash);
+    return this->_imageReadDataCache[cacheTier(targetSize)]->find(hash);
 }
@@ -7,7 +7,14 @@
 #include <QFileInfo>
 #include <QFutureWatcher>
 #include <QOpenGLContext>
-#include <QCache>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QTransform>
+#include <QHash>
+
+#include <atomic>
+#include <functional>
 
 #define THUMBNAIL_WIDE 112
 #define THUMBNAIL_HEIGHT 96
@@ -15,9 +22,17 @@
 #define THUMBNAIL_WIDE_N 192
 #define THUMBNAIL_HEIGHT_N 162
 
+// 缩略图网格尺寸档位, 最大一档即 THUMBNAIL_WIDE_N x THUMBNAIL_HEIGHT_N
+#define THUMBNAIL_TIER_COUNT 4
+// 默认档位 THUMBNAIL_WIDE x THUMBNAIL_HEIGHT
+#define THUMBNAIL_DEFAULT_TIER 2
+
 #define ICON_WIDE 48
 #define ICON_HEIGHT 48
 
+// 导出微信图片时的分块大小
+#define EXPORT_CHUNK_SIZE (256 * 1024)
+
 struct ImageReadData
 {
     QPixmap pixmap;
@@ -29,7 +44,32 @@ struct ImageReadData
 // 自定义数据类型需注册才能放入QVariant
 Q_DECLARE_METATYPE(ImageReadData);
 
-class QMimeDatabase;
+// 缓存返回引用计数句柄, 缓存淘汰时正在使用的数据不会被释放
+typedef QSharedPointer<ImageReadData> ImageReadDataPtr;
+Q_DECLARE_METATYPE(ImageReadDataPtr);
+
+// 只读文件头得到的图片信息, 不解码像素
+struct ImageProbeData
+{
+    // jpg, png, gif ...
+    QString format;
+    // 微信图片异或值, 普通图片为0
+    uchar xorKey = 0;
+    // 图片尺寸, 文件头中没有时无效
+    QSize size;
+};
+
+class ThumbnailStore;
+class ImageReadDataCache;
+
+// 解码任务优先级, 数值越大越先执行
+enum DecodePriority { PrefetchPriority = 0, ThumbnailPriority = 1, PreviewPriority = 2, ViewerPrefetchPriority = 3, ViewerPriority = 4 };
+
+// 解码任务取消标志, 置为true后未开始的任务直接丢弃, 已完成的结果不再回调
+typedef QSharedPointer<std::atomic_bool> DecodeTicket;
+
+// 内存缓存分级, 各级单独按字节计算预算
+enum ImageCacheTier { ThumbnailTier, PreviewTier, FullTier, CacheTierCount };
 
 
 class ImageCore : public QObject
@@ -48,42 +88,134 @@ public:
     //************************************
     void loadFile(const QString& fileName, const QSize& targetSize = QSize(THUMBNAIL_WIDE, THUMBNAIL_HEIGHT));
 
-    ImageReadData* readFile(const QString& fileName, const QSize& targetSize = QSize(THUMBNAIL_WIDE, THUMBNAIL_HEIGHT));
+    //************************************
+    // Method:    decode
+    // Returns:   DecodeTicket
+    // Parameter: DecodePriority priority
+    // Parameter: QObject * receiver
+    // 在解码线程池中按优先级解码, 完成后在主线程回调onLoaded, receiver已销毁则不回调
+    // 查看器任务外, 任务属于当前目录, 调用newGeneration()后旧任务被丢弃
+    //************************************
+    DecodeTicket decode(const QString& fileName, const QSize& targetSize, DecodePriority priority,
+        QObject* receiver, std::function<void(ImageReadDataPtr)> onLoaded);
+
+    // 切换目录时调用, 丢弃旧目录还未执行的解码任务
+    void newGeneration();
+
+    // 只查内存缓存, 不解码
+    ImageReadDataPtr cachedImage(const QString& fileName, const QSize& targetSize);
+
+    // 文件内容变化或被删除后调用, 丢弃它的缩略图各档和原图的内存缓存
+    // 持久化缓存的键含修改时间和大小, 不需要处理
+    void invalidateFile(const QString& fileName);
+
+    // 持久化缩略图缓存被其它进程(界面或命令行工具)占用时为true, 此时只读不写
+    bool thumbnailStoreReadOnly() const;
+
+    //************************************
+    // Method:    readFile
+    // Returns:   ImageReadDataPtr
+    // 可在多个线程中同时调用
+    //************************************
+    ImageReadDataPtr readFile(const QString& fileName, const QSize& targetSize = QSize(THUMBNAIL_WIDE, THUMBNAIL_HEIGHT));
 
     QPixmap readWeImage(const QString& fileName, long long fileSize, QString& extension, const QSize& targetSize);
 
-    void loadPixmap(const ImageReadData* readData);
+    //************************************
+    // Method:    readScaled
+    // Returns:   QImage
+    // 按目标尺寸保持宽高比解码, JPEG 使用 DCT 缩放后再对小图做平滑缩放
+    //************************************
+    QImage readScaled(QImageReader& imageReader, const QSize& targetSize);
+
+    void loadPixmap(const ImageReadDataPtr& readData);
 
-    void addToCache(const ImageReadData& readImageAndFileInfo);
+    void addToCache(const ImageReadDataPtr& readData, const QSize& targetSize);
 
+    //************************************
+    // Method:    isImageFile
+    // Returns:   bool
+    // 先查后缀表, 只有后缀不明确时才读取文件内容判断;
+    // 在主线程中不读文件, 只按文件名判断
+    //************************************
     bool isImageFile(const QFileInfo& fileInfo);
 
     QStringList imageNames();
 
     bool isWeChatImage(const QFileInfo& fileInfo);
 
+    //************************************
+    // Method:    probeImage
+    // Returns:   bool
+    // Parameter: const QFileInfo & fileInfo
+    // Parameter: ImageProbeData & probe
+    // 只读取文件头(JPEG SOF / PNG IHDR / GIF header), 得到格式, 异或值和尺寸
+    //************************************
+    bool probeImage(const QFileInfo& fileInfo, ImageProbeData& probe);
+
     QPixmap scaled(const QPixmap& originPixmap, const QSize& targetSize);
 
+    //************************************
+    // Method:    thumbnailTierSize
+    // Returns:   QSize
+    // Parameter: int tier 0 ~ THUMBNAIL_TIER_COUNT - 1, 越界时取最近的档位
+    // 更大的档位已在内存或持久化缓存中时, 较小的档位由它盒式缩小得到, 否则按本档尺寸解码
+    //************************************
+    static QSize thumbnailTierSize(int tier);
+
+    // 不是缩略图档位时返回-1
+    static int thumbnailTier(const QSize& targetSize);
+
     QPixmap flipImage(const QPixmap originPixmap, bool horizontal = true, int dir = 1);
 
     QPixmap rotateImage(const QPixmap& originPixmap, bool right = true, int dir = 1);
 
-    int exportWeChatImage(const QFileInfo& soureFile, const QString& targetPath);
+    //************************************
+    // Method:    exportWeChatImage
+    // Returns:   int 0 成功, 1 不是微信图片, 2 写入失败
+    // Parameter: const QTransform & transform
+    // 导出为原格式; jpg 的 transform 为90度倍数的旋转/翻转时只改写 EXIF 方向, 无损
+    //************************************
+    int exportWeChatImage(const QFileInfo& soureFile, const QString& targetPath, const QTransform& transform = QTransform());
 signals:
-    void imageLoaded(ImageReadData* readData);
+    void imageLoaded(ImageReadDataPtr readData);
 private:
-    QCache<uint64_t, ImageReadData>* _imageReadDataCache;
+    // cost 为像素占用的KiB: width * height * depth / 8 / 1024
+    ImageReadDataCache* _imageReadDataCache[CacheTierCount];
 
-    QMimeDatabase* _mineDb;
+    ImageCacheTier cacheTier(const QSize& targetSize);
 
-    QFutureWatcher<ImageReadData*> loadFutureWatcher;
+    // 持久化缩略图缓存
+    ThumbnailStore* _thumbnailStore;
 
-    BYTE* datConverImage(const QString& datFileName, long long fileSize, QString* extension);
+    bool isThumbnailSize(const QSize& targetSize);
 
-    void XOR(BYTE* v_pbyBuf, DWORD v_dwBufLen, BYTE byXOR);
+    //************************************
+    // Method:    findLargerTier
+    // Returns:   bool
+    // 只在内存缓存和持久化缓存中查找比 tier 大的缩略图档位, 不解码
+    //************************************
+    bool findLargerTier(const QString& fileName, const QFileInfo& fileInfo, int tier, QImage& image, QString& extension);
+
+    // 专用解码线程池, 与 QThreadPool::globalInstance() 分开
+    QThreadPool _decodePool;
+
+    QAtomicInt _generation;
+
+    DecodeTicket _previewTicket;
+
+    bool datConverImage(const QString& datFileName, QByteArray& imageData, QString* extension);
+
+    bool datXorKey(const uchar* head, QString* extension, uchar& byXOR);
+
+    //************************************
+    // Method:    readExifThumbnail
+    // Returns:   bool
+    // 只读取 JPEG 的 APP1 段, 内嵌缩略图不小于目标尺寸且宽高比与原图一致时使用
+    //************************************
+    bool readExifThumbnail(const QFileInfo& fileInfo, const QSize& targetSize, QPixmap& pixmap);
 
-    bool findImageReadData(uint64_t& hash, const QString& absoluteFilePath, const QSize& targetSize);
-    ImageReadData* getImageReadData(uint64_t hash);
+    ImageReadDataPtr findImageReadData(uint64_t& hash, const QString& absoluteFilePath, const QSize& targetSize);
 };
 
 #endif // IMAGECORE_H
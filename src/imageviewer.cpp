@@ -2,6 +2,7 @@
 #include "imagecore.h"
 #include "models/imageswitcher.h"
 #include "iconhelper.h"
+#include "component/tiledimagewidget.h"
 #include "filesystemhelperfunctions.h"
 #include "component\shscreen.h"
 
@@ -19,9 +20,12 @@
 #include <QScrollArea>
 #include <QMimeData>
 #include <QTimer>
+#include <QSet>
+
+#include "config.h"
 
 ImageViewer::ImageViewer(ImageCore* imageCore, ImageSwitcher* imageSwitcher, QWidget* parent)
-    : WxWindow(parent), _imageCore(imageCore), _imageSwitcher(imageSwitcher), _originImage(nullptr), _scale(1.0)
+    : WxWindow(parent), _imageCore(imageCore), _imageSwitcher(imageSwitcher), _scale(1.0), _fitRatio(1.0)
     , _flip(nullptr), _rotate(nullptr)
 {
     this->setAttribute(Qt::WA_DeleteOnClose);
@@ -30,11 +34,17 @@ ImageViewer::ImageViewer(ImageCore* imageCore, ImageSwitcher* imageSwitcher, QWi
 
     initUI();
 
+    _prefetchAhead = qMax(0, ConfigIni::getInstance().iniRead(QStringLiteral("Viewer/prefetchAhead"), 3).toInt());
+    _prefetchBehind = qMax(0, ConfigIni::getInstance().iniRead(QStringLiteral("Viewer/prefetchBehind"), 1).toInt());
+    _prefetchBudget = qMax(0, ConfigIni::getInstance().iniRead(QStringLiteral("Viewer/prefetchMB"), 512).toInt()) * qint64(1024 * 1024);
+
     QTimer::singleShot(1, this, &ImageViewer::on_delayLoadFile);
 }
 
 ImageViewer::~ImageViewer()
 {
+    cancelLoad();
+    cancelPrefetch();
     delete _imageSwitcher;
     if (nullptr != _flip)
     {
@@ -51,8 +61,8 @@ void ImageViewer::initUI(){
     initToolBar();
     initStatusBar();
 
-    imgArea = new QLabel();
-    imgArea->setAlignment(Qt::AlignCenter);
+    imgArea = new TiledImageWidget();
+    imgArea->setTileCacheLimit(ConfigIni::getInstance().iniRead(QStringLiteral("Viewer/tileCacheMB"), 128).toLongLong() * 1024 * 1024);
 
     scrollArea = new QScrollArea;
     scrollArea->setBackgroundRole(QPalette::Dark);
@@ -179,23 +189,221 @@ void ImageViewer::on_delayLoadFile()
 
 void ImageViewer::loadFile(const QString& absoluteFilePath)
 {
-    const ImageReadData* readData = this->_imageCore->readFile(absoluteFilePath, QSize());
-    if (readData->pixmap.isNull())
+    cancelLoad();
+
+    QFileInfo fileInfo(absoluteFilePath);
+    fileIndexLabel->setText(QString::number(this->_imageSwitcher->currIndex() + 1) + "/" + QString::number(this->_imageSwitcher->count()));
+    filePathLabel->setText(fileInfo.absoluteFilePath());
+    fileModDateLabel->setText(fileInfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"));
+    fileSizeLabel->setText(fileSizeToString(fileInfo.size()));
+
+    _exportImageAct->setEnabled(this->_imageCore->isWeChatImage(fileInfo));
+
+    // 原图加载完成前不能旋转缩放
+    this->_originImage.clear();
+    this->_currentPixmap = QPixmap();
+
+    ImageReadDataPtr readData = _prefetched.value(absoluteFilePath);
+    if (readData.isNull())
+    {
+        readData = this->_imageCore->cachedImage(absoluteFilePath, decodeSize());
+    }
+    if (!readData.isNull())
     {
+        showOriginImage(readData);
         return;
     }
 
-    fileIndexLabel->setText(QString::number(this->_imageSwitcher->currIndex() + 1) + "/" + QString::number(this->_imageSwitcher->count()));
-    filePathLabel->setText(readData->fileInfo.absoluteFilePath());
-    fileModDateLabel->setText(readData->fileInfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"));
-    fileSizeLabel->setText(fileSizeToString(readData->fileInfo.size()));
+    // 先显示预览图: 内存缓存中的预览/缩略图, 没有则快速解码一张小图
+    ImageProbeData probe;
+    if (this->_imageCore->probeImage(fileInfo, probe) && probe.size.isValid())
+    {
+        imageSizeLabel->setText(QString::number(probe.size.width()) + "x" + QString::number(probe.size.height()));
+    }
+    ImageReadDataPtr preview = this->_imageCore->cachedImage(absoluteFilePath, QSize(THUMBNAIL_WIDE_N, THUMBNAIL_HEIGHT_N));
+    if (preview.isNull())
+    {
+        preview = this->_imageCore->cachedImage(absoluteFilePath, QSize(THUMBNAIL_WIDE, THUMBNAIL_HEIGHT));
+    }
+    if (!preview.isNull())
+    {
+        displayPreview(preview->pixmap);
+    }
+    else
+    {
+        _previewTicket = this->_imageCore->decode(absoluteFilePath, QSize(THUMBNAIL_WIDE_N, THUMBNAIL_HEIGHT_N), ViewerPriority, this,
+            [this](ImageReadDataPtr previewData) {
+                if (this->_originImage.isNull() && !previewData.isNull())
+                {
+                    displayPreview(previewData->pixmap);
+                }
+            });
+    }
+
+    // 原图在后台解码, 完成后替换预览图
+    _fullTicket = this->_imageCore->decode(absoluteFilePath, decodeSize(), ViewerPriority, this, [this](ImageReadDataPtr fullData) {
+        showOriginImage(fullData);
+        });
+}
+
+void ImageViewer::cancelLoad()
+{
+    if (!_previewTicket.isNull())
+    {
+        *_previewTicket = true;
+        _previewTicket.clear();
+    }
+    if (!_fullTicket.isNull())
+    {
+        *_fullTicket = true;
+        _fullTicket.clear();
+    }
+    if (!_nativeTicket.isNull())
+    {
+        *_nativeTicket = true;
+        _nativeTicket.clear();
+    }
+}
 
-    _exportImageAct->setEnabled(this->_imageCore->isWeChatImage(readData->fileInfo));
+void ImageViewer::displayPreview(const QPixmap& preview)
+{
+    if (preview.isNull())
+    {
+        return;
+    }
+    // 预览图放大到窗口大小, 只是占位, 由显示控件绘制时缩放
+    const QSize viewSize = scrollArea->size() - QSize(2, 2);
+    displayImage(preview, qMin(double(viewSize.width()) / preview.width(), double(viewSize.height()) / preview.height()));
+}
 
-    this->_originImage = const_cast<ImageReadData*>(readData);
+void ImageViewer::showOriginImage(ImageReadDataPtr readData)
+{
+    if (readData.isNull() || readData->pixmap.isNull())
+    {
+        return;
+    }
+    this->_originImage = readData;
     this->_currentPixmap = this->_originImage->pixmap;
 
+    // 按窗口解码时记录与原图的比例, 长边之比与旋转无关
+    _fitRatio = 1.0;
+    ImageProbeData probe;
+    if (this->_imageCore->probeImage(readData->fileInfo, probe) && probe.size.isValid())
+    {
+        const int nativeLong = qMax(probe.size.width(), probe.size.height());
+        const int decodedLong = qMax(_currentPixmap.width(), _currentPixmap.height());
+        _fitRatio = qMax(1.0, double(nativeLong) / qMax(1, decodedLong));
+    }
+
     loadImage(ImageLoadType::normal);
+
+    // 当前图片显示后再预取, 不与它争抢解码线程
+    prefetchNeighbours();
+}
+
+void ImageViewer::requestNativeImage()
+{
+    if (_fitRatio <= 1.0 || _originImage.isNull() || !_nativeTicket.isNull())
+    {
+        return;
+    }
+    _nativeTicket = this->_imageCore->decode(_originImage->fileInfo.absoluteFilePath(), QSize(), ViewerPriority, this,
+        [this](ImageReadDataPtr readData) {
+            showNativeImage(readData);
+        });
+}
+
+void ImageViewer::showNativeImage(ImageReadDataPtr readData)
+{
+    _nativeTicket.clear();
+    if (readData.isNull() || readData->pixmap.isNull())
+    {
+        return;
+    }
+    this->_originImage = readData;
+    this->_currentPixmap = readData->pixmap.transformed(_viewTransform);
+    // 保持显示大小不变
+    _scale = _scale / _fitRatio;
+    _fitRatio = 1.0;
+    loadImage(ImageLoadType::zoomIn);
+}
+
+void ImageViewer::prefetchNeighbours()
+{
+    // 按当前图片大小估算预算内能放几张
+    const qint64 imageBytes = qMax<qint64>(1, qint64(_currentPixmap.width()) * _currentPixmap.height() * _currentPixmap.depth() / 8);
+    const int count = static_cast<int>(qMin<qint64>(_prefetchAhead + _prefetchBehind, _prefetchBudget / imageBytes));
+    const int ahead = qMin(_prefetchAhead, count);
+    const int behind = qMin(_prefetchBehind, count - ahead);
+
+    const QString current = _originImage.isNull() ? QString() : _originImage->fileInfo.absoluteFilePath();
+    QSet<QString> wanted;
+    wanted.insert(current);
+    for (const QFileInfo& fileInfo : _imageSwitcher->neighbours(ahead, behind))
+    {
+        if (!fileInfo.isFile() || !this->_imageCore->isImageFile(fileInfo))
+        {
+            continue;
+        }
+        const QString path = fileInfo.absoluteFilePath();
+        wanted.insert(path);
+        if (_prefetched.contains(path) || _prefetchTickets.contains(path))
+        {
+            continue;
+        }
+        ImageReadDataPtr cached = this->_imageCore->cachedImage(path, decodeSize());
+        if (!cached.isNull())
+        {
+            _prefetched.insert(path, cached);
+            continue;
+        }
+        _prefetchTickets.insert(path, this->_imageCore->decode(path, decodeSize(), ViewerPrefetchPriority, this,
+            [this, path](ImageReadDataPtr readData) {
+                _prefetchTickets.remove(path);
+                if (!readData.isNull() && !readData->pixmap.isNull())
+                {
+                    _prefetched.insert(path, readData);
+                }
+            }));
+    }
+
+    // 离开预取窗口的释放或取消
+    for (auto it = _prefetched.begin(); it != _prefetched.end();)
+    {
+        it = wanted.contains(it.key()) ? std::next(it) : _prefetched.erase(it);
+    }
+    for (auto it = _prefetchTickets.begin(); it != _prefetchTickets.end();)
+    {
+        if (wanted.contains(it.key()))
+        {
+            ++it;
+            continue;
+        }
+        *it.value() = true;
+        it = _prefetchTickets.erase(it);
+    }
+}
+
+void ImageViewer::cancelPrefetch()
+{
+    for (const auto& ticket : std::as_const(_prefetchTickets))
+    {
+        *ticket = true;
+    }
+    _prefetchTickets.clear();
+    _prefetched.clear();
+}
+
+QSize ImageViewer::decodeSize() const
+{
+    // 适应窗口显示时只需要窗口大小的物理像素
+    QSize viewSize = scrollArea->size();
+    if (viewSize.width() < 64 || viewSize.height() < 64)
+    {
+        // 窗口还未布局
+        viewSize = ShScreen::normalRect().size();
+    }
+    return viewSize * devicePixelRatioF();
 }
 
 void ImageViewer::loadImage(ImageLoadType loadType)
@@ -211,11 +419,19 @@ void ImageViewer::loadImage(ImageLoadType loadType)
         break;
     case flip:
         pix = flipImage(_currentPixmap);
+        if (nullptr != _flip)
+        {
+            _viewTransform = _viewTransform * (_flip->horizontal ? QTransform::fromScale(-1, 1) : QTransform::fromScale(1, -1));
+        }
         computeScaleWithView(pix);
         _currentPixmap = pix;
         break;
     case rotate:
         pix = rotateImage(_currentPixmap);
+        if (nullptr != _rotate)
+        {
+            _viewTransform = _viewTransform * QTransform().rotate(_rotate->right ? 90 : -90);
+        }
         computeScaleWithView(pix);
         _currentPixmap = pix;
         break;
@@ -226,30 +442,20 @@ void ImageViewer::loadImage(ImageLoadType loadType)
     default:
         return;
     }
-    displayImage(resizeImage(pix));
-    imageSizeLabel->setText(QString::number(pix.width()) + "x" + QString::number(pix.height()));
-    imageScaleLabel->setText(QString::number(((float)((int)((_scale + 0.005) * 100)))) + " %");
+    displayImage(pix, _scale);
+    // 尺寸和缩放比都相对原图
+    imageSizeLabel->setText(QString::number(qRound(pix.width() * _fitRatio)) + "x" + QString::number(qRound(pix.height() * _fitRatio)));
+    imageScaleLabel->setText(QString::number(((float)((int)((_scale / _fitRatio + 0.005) * 100)))) + " %");
 }
 
-QPixmap ImageViewer::resizeImage(const QPixmap& pixmap)
-{
-    if (pixmap.isNull())
+void ImageViewer::displayImage(const QPixmap& pixmap, double scale) {
+    // 缩放不再生成整张缩放图, 只在图片变化时重建分块
+    if (pixmap.cacheKey() != _displayedKey)
     {
-        return QPixmap();
+        _displayedKey = pixmap.cacheKey();
+        imgArea->setPixmap(pixmap);
     }
-
-    if (_scale == 1)
-    {
-        return pixmap;
-    }
-    int width = floor(pixmap.width() * _scale);
-    int height = floor(pixmap.height() * _scale);
-    return this->_imageCore->scaled(pixmap, QSize(width, height));
-}
-
-void ImageViewer::displayImage(const QPixmap pixmap) {
-    imgArea->setPixmap(pixmap);
-    imgArea->adjustSize();
+    imgArea->setScale(scale);
 }
 
 double ImageViewer::computeScaleWithView(const QPixmap pixmap) {
@@ -345,6 +551,8 @@ void ImageViewer::on_refreshImage_clicked()
 void ImageViewer::initImageParam()
 {
     _scale = 1.0;
+    _fitRatio = 1.0;
+    _viewTransform.reset();
     if (nullptr != _flip)
     {
         delete _flip;
@@ -421,6 +629,11 @@ void ImageViewer::on_zoomInImage_clicked()
             _scale = 4;
         }
         loadImage(ImageLoadType::zoomIn);
+        if (_scale > 1.0)
+        {
+            // 超过解码尺寸, 换成原图
+            requestNativeImage();
+        }
     }
 }
 
@@ -440,9 +653,11 @@ void ImageViewer::on_zoomOutImage_clicked()
 void ImageViewer::on_extendImage_clicked()
 {
     const double epslion = 1e-8;
-    if (abs(_scale - 1.0) > epslion) {
-        _scale = 1.0;
+    if (abs(_scale - _fitRatio) > epslion) {
+        // 原图100%
+        _scale = _fitRatio;
         loadImage(ImageLoadType::extend);
+        requestNativeImage();
     }
 }
 
@@ -453,6 +668,8 @@ void ImageViewer::on_exportImage_clicked()
         "",
         QFileDialog::ShowDirsOnly | QFileDialog::DontResolveSymlinks/* | QFileDialog::DontUseNativeDialog*/);
     if (directory != "") {
-        this->_imageCore->exportWeChatImage(_imageSwitcher->getImage(), directory);
+        // 导出时保留查看器中的旋转/翻转, jpg 只改写 EXIF 方向
+        const bool keepRotation = ConfigIni::getInstance().iniRead(QStringLiteral("Export/losslessRotate"), true).toBool();
+        this->_imageCore->exportWeChatImage(_imageSwitcher->getImage(), directory, keepRotation ? _viewTransform : QTransform());
     }
 }
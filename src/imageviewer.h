@@ -2,13 +2,16 @@
 #define IMAGEVIEWER_H
 
 #include "component/wxwindow.h"
+#include "imagecore.h"
+
+#include <QHash>
+#include <QTransform>
 
-class ImageCore;
 class ImageSwitcher;
 class QLabel;
+class TiledImageWidget;
 class QScrollArea;
 class QAction;
-class ImageReadData;
 
 
 enum ImageLoadType { normal, flip, rotate, zoomIn, zoomOut, extend };
@@ -61,7 +64,8 @@ private:
     } Rotate;
 
     //界面对象
-    QLabel *imgArea;//图片显示区域
+    TiledImageWidget *imgArea;//图片显示区域
+    qint64 _displayedKey = 0;//当前显示图片的 cacheKey
     QScrollArea *scrollArea;//图片展示窗口
     QLabel *fileIndexLabel;//文件索引Label
     QLabel *filePathLabel;//文件路径Label
@@ -75,7 +79,26 @@ private:
     ImageSwitcher* _imageSwitcher;
     ImageCore* _imageCore;
 
-    ImageReadData* _originImage;
+    ImageReadDataPtr _originImage;
+
+    // 预览图和原图的后台解码, 切换图片时取消
+    DecodeTicket _previewTicket;
+    DecodeTicket _fullTicket;
+
+    // 查看器按窗口大小解码, 放大超过100%时再解码原图
+    DecodeTicket _nativeTicket;
+    // 原图尺寸 / 当前解码尺寸
+    double _fitRatio;
+    // 已经应用到 _currentPixmap 的旋转翻转, 替换为原图时重新应用
+    QTransform _viewTransform;
+
+    // 相邻图片预取: 沿浏览方向预取 _prefetchAhead 张, 反方向 _prefetchBehind 张
+    int _prefetchAhead;
+    int _prefetchBehind;
+    qint64 _prefetchBudget;
+    // 持有句柄, 内存缓存淘汰后仍可直接显示
+    QHash<QString, ImageReadDataPtr> _prefetched;
+    QHash<QString, DecodeTicket> _prefetchTickets;
 
     QPixmap _currentPixmap;
 
@@ -95,11 +118,27 @@ private:
 
     void loadFile(const QString& absoluteFilePath);
 
-    void loadImage(ImageLoadType loadType);
+    void cancelLoad();
+
+    void displayPreview(const QPixmap& preview);
+
+    void showOriginImage(ImageReadDataPtr readData);
 
-    QPixmap resizeImage(const QPixmap& pixmap);
+    void prefetchNeighbours();
+
+    void requestNativeImage();
+
+    void showNativeImage(ImageReadDataPtr readData);
+
+    void cancelPrefetch();
+
+    // 查看器的解码尺寸
+    QSize decodeSize() const;
+
+    void loadImage(ImageLoadType loadType);
 
-    void displayImage(const QPixmap pixmap);
+    // 显示图片, scale 为显示尺寸与图片尺寸之比
+    void displayImage(const QPixmap& pixmap, double scale);
 
     double computeScaleWithView(const QPixmap pixmap);
 
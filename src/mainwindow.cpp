@@ -197,9 +197,9 @@ QString MainWindow::getWeChatImagePath()
     return fileSavePath;
 }
 
-void MainWindow::imageLoaded(ImageReadData* readData)
+void MainWindow::imageLoaded(ImageReadDataPtr readData)
 {
-    if (nullptr == readData)
+    if (readData.isNull())
     {
         return;
     }
@@ -2,13 +2,12 @@
 #define MAINWINDOW_H
 
 #include "component/wxwindow.h"
+#include "imagecore.h"
 
 class NavDockWidget;
 class QFileSystemModel;
-class ImageCore;
 class QStatusBar;
 class QLabel;
-class ImageReadData;
 
 class MainWindow : public WxWindow
 {
@@ -50,7 +49,7 @@ private:
 private slots:
     void about();
     void onCdDir(const QString path);
-    void imageLoaded(ImageReadData* readData);
+    void imageLoaded(ImageReadDataPtr readData);
     void onCdWechatImage();
 signals:
     void setPath(const QString path);
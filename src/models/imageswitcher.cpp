@@ -1,8 +1,7 @@
 #include "imageswitcher.h"
-#include "../delegate/thumbnailData.h"
 
 ImageSwitcher::ImageSwitcher(const QModelIndex& current, const FileFilterProxyModel* model)
-    :_image(current), _model(model)
+    :_image(current), _model(model), _direction(1)
 {
 }
 
@@ -21,7 +20,38 @@ int ImageSwitcher::currIndex()
     return _image.row();
 }
 
+int ImageSwitcher::direction() const
+{
+    return _direction;
+}
+
+QList<QFileInfo> ImageSwitcher::neighbours(int ahead, int behind)
+{
+    QList<QFileInfo> list;
+    const int rowCount = _model->rowCount();
+    if (rowCount <= 1)
+    {
+        return list;
+    }
+    ahead = qMin(ahead, rowCount - 1);
+    behind = qMin(behind, rowCount - 1 - ahead);
+    const int row = _image.row();
+    for (int i = 1; i <= qMax(ahead, behind); ++i)
+    {
+        if (i <= ahead)
+        {
+            list.append(_model->fileInfo(_model->index((row + _direction * i + rowCount) % rowCount, 0)));
+        }
+        if (i <= behind)
+        {
+            list.append(_model->fileInfo(_model->index((row - _direction * i + rowCount) % rowCount, 0)));
+        }
+    }
+    return list;
+}
+
 QFileInfo ImageSwitcher::previous() {
+    _direction = -1;
     if (_image.row() <= 0) {
         _image = _model->index(_model->rowCount() - 1, 0);
     }
@@ -32,6 +62,7 @@ QFileInfo ImageSwitcher::previous() {
 }
 
 QFileInfo ImageSwitcher::next() {
+    _direction = 1;
     if (_image.row() >= _model->rowCount() - 1) {
         _image = _model->index(0, 0);
     }
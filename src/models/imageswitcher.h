@@ -3,6 +3,7 @@
 
 #include "..\filelistmodel\filefilterproxymodel.h"
 #include <QFileInfo>
+#include <QList>
 
 class ImageSwitcher
 {
@@ -16,9 +17,16 @@ private:
 
     QModelIndex _image;
 
+    // 最近一次切换的方向, 1 向后, -1 向前
+    int _direction;
+
 public:
     int count();
     int currIndex();
+    int direction() const;
+
+    // 当前图片前后的文件, 按距离由近到远, 首尾相接
+    QList<QFileInfo> neighbours(int ahead, int behind);
 public slots:
     QFileInfo previous();
     QFileInfo next();
@@ -111,9 +111,9 @@ void NavDockWidget::onCdDir(const QString path)
     this->treeView->setCurrentIndex(index);
 }
 
-void NavDockWidget::imageLoaded(ImageReadData* readData)
+void NavDockWidget::imageLoaded(ImageReadDataPtr readData)
 {
-    if (nullptr == readData)
+    if (readData.isNull())
     {
         this->thumbnail->setVisible(false);
     }
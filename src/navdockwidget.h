@@ -3,13 +3,13 @@
 
 #include <QDockWidget>
 
+#include "imagecore.h"
+
 class QLabel;
-class ImageCore;
 class QFileSystemModel;
 class FileFilterProxyModel;
 class QTreeView;
 class QAbstractItemModel;
-class ImageReadData;
 
 class NavDockWidget : public QDockWidget
 {
@@ -36,7 +36,7 @@ private:
     void currentRowChanged();
 private slots:
     void onTreeViewClicked(const QModelIndex& index);
-    void imageLoaded(ImageReadData* readData);
+    void imageLoaded(ImageReadDataPtr readData);
 signals:
     void treeViewClicked(const QString path);
 };
@@ -0,0 +1,65 @@
+#include "imagefiletype.h"
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QMimeDatabase>
+#include <QThread>
+
+namespace
+{
+enum SuffixKind { ImageSuffix, OtherSuffix, AmbiguousSuffix };
+
+// 后缀 -> 类型, 第一次使用时生成, 之后只读, 可多线程查询
+const QHash<QString, SuffixKind>& suffixKinds()
+{
+    static const QHash<QString, SuffixKind> kinds = []() {
+        QHash<QString, SuffixKind> result;
+        // 一个后缀可能属于多个 MIME 类型, 都是图片或都不是图片时才是明确的
+        const QList<QMimeType> mimeList = QMimeDatabase().allMimeTypes();
+        for (const QMimeType& mime : mimeList)
+        {
+            const SuffixKind kind = mime.name().startsWith(QStringLiteral("image/")) ? ImageSuffix : OtherSuffix;
+            for (const QString& suffix : mime.suffixes())
+            {
+                const QString key = suffix.toLower();
+                auto it = result.find(key);
+                if (it == result.end())
+                {
+                    result.insert(key, kind);
+                }
+                else if (it.value() != kind)
+                {
+                    it.value() = AmbiguousSuffix;
+                }
+            }
+        }
+        return result;
+    }();
+    return kinds;
+}
+}
+
+bool isWeChatImageFile(const QFileInfo& fileInfo)
+{
+    return fileInfo.suffix() == "dat" && fileInfo.baseName().length() == 32;
+}
+
+bool classifyImageFile(const QFileInfo& fileInfo)
+{
+    if (isWeChatImageFile(fileInfo))
+    {
+        // wechat picture
+        return true;
+    }
+
+    // 未知后缀(包括没有后缀)和不明确的后缀需要看内容
+    const SuffixKind kind = suffixKinds().value(fileInfo.suffix().toLower(), AmbiguousSuffix);
+    if (kind != AmbiguousSuffix)
+    {
+        return kind == ImageSuffix;
+    }
+    // QMimeDatabase 内部共享并加锁, 每次构造开销很小
+    const bool guiThread = QThread::currentThread() == QCoreApplication::instance()->thread();
+    const QMimeType mime = QMimeDatabase().mimeTypeForFile(fileInfo, guiThread ? QMimeDatabase::MatchExtension : QMimeDatabase::MatchDefault);
+    return mime.name().startsWith(QStringLiteral("image/"));
+}
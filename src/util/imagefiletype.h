@@ -0,0 +1,19 @@
+#ifndef _IMAGEFILETYPE_H
+#define _IMAGEFILETYPE_H
+
+#include <QFileInfo>
+
+/**
+ * isWeChatImageFile - name check only: 32 character base name with .dat suffix
+ */
+bool isWeChatImageFile(const QFileInfo& fileInfo);
+
+/**
+ * classifyImageFile - whether @fileInfo is an image. Looks up a suffix table
+ * built once from the mime database; only unknown or ambiguous suffixes read
+ * the file content, and never from the gui thread (name match only there).
+ * Needs no ImageCore instance and is safe to call from any thread.
+ */
+bool classifyImageFile(const QFileInfo& fileInfo);
+
+#endif
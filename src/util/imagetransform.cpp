@@ -0,0 +1,345 @@
+#include "imagetransform.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define TRANSFORM_NEON 1
+#include <arm_neon.h>
+#endif
+
+// 分块边长, 32x32个32位像素源块和目标块各4KiB, 都能留在L1中
+#define TRANSFORM_BLOCK 32
+
+struct Pixel24
+{
+    uchar c[3];
+};
+
+struct TransformPlane
+{
+    const uchar* src;
+    qsizetype srcStride;
+    uchar* dst;
+    qsizetype dstStride;
+    int width;
+    int height;
+};
+
+template <typename T>
+static inline const T* srcRow(const TransformPlane& p, int y)
+{
+    return reinterpret_cast<const T*>(p.src + y * p.srcStride);
+}
+
+template <typename T>
+static inline T* dstRow(const TransformPlane& p, int y)
+{
+    return reinterpret_cast<T*>(p.dst + y * p.dstStride);
+}
+
+#if defined(TRANSFORM_SSE2) || defined(TRANSFORM_NEON)
+// 源图(x, y)起的4x4块转置后写入目标(dx, dy), reverse为true时每行反向
+static inline void transpose4x4(const uint32_t* s, qsizetype sStride, uint32_t* d, qsizetype dStride, bool reverse)
+{
+#ifdef TRANSFORM_SSE2
+    const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + sStride));
+    const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2 * sStride));
+    const __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 3 * sStride));
+    const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+    const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+    const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+    __m128i c[4] = { _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+        _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3) };
+    for (int i = 0; i < 4; ++i)
+    {
+        if (reverse)
+            c[i] = _mm_shuffle_epi32(c[i], _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * dStride), c[i]);
+    }
+#else
+    const uint32x4x2_t p01 = vtrnq_u32(vld1q_u32(s), vld1q_u32(s + sStride));
+    const uint32x4x2_t p23 = vtrnq_u32(vld1q_u32(s + 2 * sStride), vld1q_u32(s + 3 * sStride));
+    uint32x4_t c[4] = { vcombine_u32(vget_low_u32(p01.val[0]), vget_low_u32(p23.val[0])),
+        vcombine_u32(vget_low_u32(p01.val[1]), vget_low_u32(p23.val[1])),
+        vcombine_u32(vget_high_u32(p01.val[0]), vget_high_u32(p23.val[0])),
+        vcombine_u32(vget_high_u32(p01.val[1]), vget_high_u32(p23.val[1])) };
+    for (int i = 0; i < 4; ++i)
+    {
+        if (reverse)
+        {
+            const uint32x4_t r = vrev64q_u32(c[i]);
+            c[i] = vcombine_u32(vget_high_u32(r), vget_low_u32(r));
+        }
+        vst1q_u32(d + i * dStride, c[i]);
+    }
+#endif
+}
+#endif
+
+// 顺时针: 源(x, y) -> 目标(h - 1 - y, x); 逆时针: 源(x, y) -> 目标(y, w - 1 - x)
+template <typename T>
+static void rotate90Block(const TransformPlane& p, int bx, int by, int bw, int bh, bool clockwise)
+{
+    for (int y = by; y < by + bh; ++y)
+    {
+        const T* s = srcRow<T>(p, y);
+        const int dx = clockwise ? p.height - 1 - y : y;
+        for (int x = bx; x < bx + bw; ++x)
+        {
+            dstRow<T>(p, clockwise ? x : p.width - 1 - x)[dx] = s[x];
+        }
+    }
+}
+
+template <typename T>
+static void rotate90Plane(const TransformPlane& p, bool clockwise)
+{
+    for (int by = 0; by < p.height; by += TRANSFORM_BLOCK)
+    {
+        const int bh = qMin(TRANSFORM_BLOCK, p.height - by);
+        for (int bx = 0; bx < p.width; bx += TRANSFORM_BLOCK)
+        {
+            rotate90Block<T>(p, bx, by, qMin(TRANSFORM_BLOCK, p.width - bx), bh, clockwise);
+        }
+    }
+}
+
+#if defined(TRANSFORM_SSE2) || defined(TRANSFORM_NEON)
+template <>
+void rotate90Plane<uint32_t>(const TransformPlane& p, bool clockwise)
+{
+    const qsizetype sStride = p.srcStride / 4;
+    const qsizetype dStride = p.dstStride / 4;
+    for (int by = 0; by < p.height; by += TRANSFORM_BLOCK)
+    {
+        const int bh = qMin(TRANSFORM_BLOCK, p.height - by);
+        for (int bx = 0; bx < p.width; bx += TRANSFORM_BLOCK)
+        {
+            const int bw = qMin(TRANSFORM_BLOCK, p.width - bx);
+            // 块内4x4部分用SIMD, 右边和下边的余数逐像素处理
+            const int bw4 = bw & ~3;
+            const int bh4 = bh & ~3;
+            for (int y = by; y < by + bh4; y += 4)
+            {
+                const uint32_t* s = srcRow<uint32_t>(p, y);
+                for (int x = bx; x < bx + bw4; x += 4)
+                {
+                    if (clockwise)
+                        transpose4x4(s + x, sStride, dstRow<uint32_t>(p, x) + (p.height - 4 - y), dStride, true);
+                    else
+                        transpose4x4(s + x, sStride, dstRow<uint32_t>(p, p.width - 1 - x) + y, -dStride, false);
+                }
+            }
+            if (bw4 < bw)
+                rotate90Block<uint32_t>(p, bx + bw4, by, bw - bw4, bh, clockwise);
+            if (bh4 < bh)
+                rotate90Block<uint32_t>(p, bx, by + bh4, bw4, bh - bh4, clockwise);
+        }
+    }
+}
+#endif
+
+template <typename T>
+static void reverseRow(const T* s, T* d, int width)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        d[width - 1 - x] = s[x];
+    }
+}
+
+#if defined(TRANSFORM_SSE2) || defined(TRANSFORM_NEON)
+template <>
+void reverseRow<uint32_t>(const uint32_t* s, uint32_t* d, int width)
+{
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+#ifdef TRANSFORM_SSE2
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + width - 4 - x), _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+#else
+        const uint32x4_t r = vrev64q_u32(vld1q_u32(s + x));
+        vst1q_u32(d + width - 4 - x, vcombine_u32(vget_high_u32(r), vget_low_u32(r)));
+#endif
+    }
+    for (; x < width; ++x)
+    {
+        d[width - 1 - x] = s[x];
+    }
+}
+#endif
+
+// flipRows: 目标第y行来自源第h-1-y行; reverse: 行内反向
+template <typename T>
+static void mirrorPlane(const TransformPlane& p, bool flipRows, bool reverse)
+{
+    const size_t rowBytes = size_t(p.width) * sizeof(T);
+    for (int y = 0; y < p.height; ++y)
+    {
+        const T* s = srcRow<T>(p, y);
+        T* d = dstRow<T>(p, flipRows ? p.height - 1 - y : y);
+        if (reverse)
+            reverseRow<T>(s, d, p.width);
+        else
+            memcpy(d, s, rowBytes);
+    }
+}
+
+// 不支持的位深(1bpp等)先转为32位
+static QImage transformSource(const QImage& image)
+{
+    switch (image.depth())
+    {
+    case 8:
+    case 16:
+    case 24:
+    case 32:
+    case 64:
+        return image;
+    default:
+        return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+}
+
+static QImage transformTarget(const QImage& src, int width, int height, bool swapDpm)
+{
+    QImage dst(width, height, src.format());
+    if (dst.isNull())
+        return dst;
+    dst.setColorTable(src.colorTable());
+    dst.setColorSpace(src.colorSpace());
+    dst.setDevicePixelRatio(src.devicePixelRatio());
+    dst.setDotsPerMeterX(swapDpm ? src.dotsPerMeterY() : src.dotsPerMeterX());
+    dst.setDotsPerMeterY(swapDpm ? src.dotsPerMeterX() : src.dotsPerMeterY());
+    return dst;
+}
+
+template <template <typename> class Op, typename... Args>
+static void dispatchDepth(int depth, const TransformPlane& p, Args... args)
+{
+    switch (depth)
+    {
+    case 8: Op<uint8_t>::run(p, args...); break;
+    case 16: Op<uint16_t>::run(p, args...); break;
+    case 24: Op<Pixel24>::run(p, args...); break;
+    case 32: Op<uint32_t>::run(p, args...); break;
+    case 64: Op<uint64_t>::run(p, args...); break;
+    default: break;
+    }
+}
+
+template <typename T>
+struct Rotate90Op
+{
+    static void run(const TransformPlane& p, bool clockwise) { rotate90Plane<T>(p, clockwise); }
+};
+
+template <typename T>
+struct MirrorOp
+{
+    static void run(const TransformPlane& p, bool flipRows, bool reverse) { mirrorPlane<T>(p, flipRows, reverse); }
+};
+
+QImage rotateImage90(const QImage& image, bool clockwise)
+{
+    if (image.isNull())
+        return image;
+    const QImage src = transformSource(image);
+    QImage dst = transformTarget(src, src.height(), src.width(), true);
+    if (dst.isNull())
+        return dst;
+    const TransformPlane p = { src.constBits(), src.bytesPerLine(), dst.bits(), dst.bytesPerLine(), src.width(), src.height() };
+    dispatchDepth<Rotate90Op>(src.depth(), p, clockwise);
+    return dst;
+}
+
+QImage rotateImage180(const QImage& image)
+{
+    if (image.isNull())
+        return image;
+    const QImage src = transformSource(image);
+    QImage dst = transformTarget(src, src.width(), src.height(), false);
+    if (dst.isNull())
+        return dst;
+    const TransformPlane p = { src.constBits(), src.bytesPerLine(), dst.bits(), dst.bytesPerLine(), src.width(), src.height() };
+    dispatchDepth<MirrorOp>(src.depth(), p, true, true);
+    return dst;
+}
+
+QImage mirrorImage(const QImage& image, bool horizontal)
+{
+    if (image.isNull())
+        return image;
+    const QImage src = transformSource(image);
+    QImage dst = transformTarget(src, src.width(), src.height(), false);
+    if (dst.isNull())
+        return dst;
+    const TransformPlane p = { src.constBits(), src.bytesPerLine(), dst.bits(), dst.bytesPerLine(), src.width(), src.height() };
+    dispatchDepth<MirrorOp>(src.depth(), p, !horizontal, horizontal);
+    return dst;
+}
+
+QImage boxDownsample(const QImage& image, const QSize& size)
+{
+    if (image.isNull() || size.isEmpty())
+        return QImage();
+    const int dw = qMin(size.width(), image.width());
+    const int dh = qMin(size.height(), image.height());
+    if (dw == image.width() && dh == image.height())
+        return image;
+    const QImage src = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    QImage dst = transformTarget(src, dw, dh, false);
+    if (dst.isNull())
+        return dst;
+    const int sw = src.width();
+    const int sh = src.height();
+
+    // 目标第 dx 列对应源列 [xs[dx], xs[dx + 1])
+    QList<int> xs(dw + 1);
+    for (int i = 0; i <= dw; ++i)
+    {
+        xs[i] = int(qint64(i) * sw / dw);
+    }
+    // 4个通道分别累加, 与字节序无关
+    QList<quint64> acc(qsizetype(dw) * 4);
+    for (int dy = 0; dy < dh; ++dy)
+    {
+        const int y0 = int(qint64(dy) * sh / dh);
+        const int y1 = qMax(y0 + 1, int(qint64(dy + 1) * sh / dh));
+        acc.fill(0);
+        for (int y = y0; y < y1; ++y)
+        {
+            const uchar* s = src.constScanLine(y);
+            quint64* a = acc.data();
+            for (int dx = 0; dx < dw; ++dx, a += 4)
+            {
+                const int xEnd = qMax(xs[dx] + 1, xs[dx + 1]);
+                for (int x = xs[dx]; x < xEnd; ++x)
+                {
+                    a[0] += s[x * 4];
+                    a[1] += s[x * 4 + 1];
+                    a[2] += s[x * 4 + 2];
+                    a[3] += s[x * 4 + 3];
+                }
+            }
+        }
+        uchar* d = dst.scanLine(dy);
+        const quint64* a = acc.constData();
+        for (int dx = 0; dx < dw; ++dx, a += 4)
+        {
+            const quint64 count = quint64(y1 - y0) * quint64(qMax(xs[dx] + 1, xs[dx + 1]) - xs[dx]);
+            for (int c = 0; c < 4; ++c)
+            {
+                d[dx * 4 + c] = uchar((a[c] + count / 2) / count);
+            }
+        }
+    }
+    return dst;
+}
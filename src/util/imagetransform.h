@@ -0,0 +1,36 @@
+#ifndef _IMAGETRANSFORM_H
+#define _IMAGETRANSFORM_H
+
+#include <QImage>
+
+/**
+ * rotateImage90 - exact 90 degree rotation, pixels are moved not resampled.
+ * Works on raw scanlines in cache-sized blocks, 32bpp blocks use a SIMD
+ * 4x4 transpose (SSE2 / NEON).
+ * @image: source image, 8/16/24/32/64 bpp are rotated in place format,
+ *         other formats are converted to ARGB32 first
+ * @clockwise: rotate clockwise when true
+ */
+QImage rotateImage90(const QImage& image, bool clockwise);
+
+/**
+ * rotateImage180 - exact 180 degree rotation
+ */
+QImage rotateImage180(const QImage& image);
+
+/**
+ * mirrorImage - exact mirror
+ * @horizontal: mirror left-right when true, top-bottom otherwise
+ */
+QImage mirrorImage(const QImage& image, bool horizontal);
+
+/**
+ * boxDownsample - shrink by averaging each box of source pixels that maps
+ * to one destination pixel. Much cheaper than a smooth resample and good
+ * for deriving smaller thumbnails from a larger one. Never upscales.
+ * @image: source image, converted to 32bpp
+ * @size: target size, at most the source size in each direction
+ */
+QImage boxDownsample(const QImage& image, const QSize& size);
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef _PARALLELSORT_H
+#define _PARALLELSORT_H
+
+#include <QList>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+// 小于此长度时单线程排序
+#define PARALLEL_SORT_MIN_CHUNK 4096
+
+/**
+ * parallelSort - sort @data with @less, splitting it into one chunk per
+ * core, sorting the chunks on the global thread pool and then merging
+ * neighbouring runs pairwise, each merge round also in parallel.
+ * @data: values to sort, usually a row permutation
+ * @less: strict weak ordering, must be safe to call from several threads
+ */
+template <typename T, typename Less>
+void parallelSort(QList<T>& data, Less less)
+{
+    const qsizetype n = data.size();
+    const qsizetype chunks = qMin<qsizetype>(QThread::idealThreadCount(), n / PARALLEL_SORT_MIN_CHUNK);
+    T* base = data.data();
+    if (chunks <= 1)
+    {
+        std::sort(base, base + n, less);
+        return;
+    }
+
+    // 各块 [bounds[i], bounds[i+1])
+    QList<qsizetype> bounds;
+    for (qsizetype i = 0; i <= chunks; ++i)
+    {
+        bounds.append(n * i / chunks);
+    }
+    QList<std::pair<qsizetype, qsizetype>> runs;
+    for (qsizetype i = 0; i < chunks; ++i)
+    {
+        runs.append({ bounds[i], bounds[i + 1] });
+    }
+    QtConcurrent::blockingMap(runs, [base, less](const std::pair<qsizetype, qsizetype>& run) {
+        std::sort(base + run.first, base + run.second, less);
+    });
+
+    // 相邻两段合并, 直到只剩一段
+    while (runs.size() > 1)
+    {
+        QList<std::pair<qsizetype, qsizetype>> merged;
+        QList<std::pair<std::pair<qsizetype, qsizetype>, qsizetype>> tasks;
+        for (qsizetype i = 0; i + 1 < runs.size(); i += 2)
+        {
+            tasks.append({ { runs[i].first, runs[i + 1].second }, runs[i].second });
+            merged.append({ runs[i].first, runs[i + 1].second });
+        }
+        if (runs.size() % 2)
+        {
+            merged.append(runs.last());
+        }
+        QtConcurrent::blockingMap(tasks, [base, less](const std::pair<std::pair<qsizetype, qsizetype>, qsizetype>& task) {
+            std::inplace_merge(base + task.first.first, base + task.second, base + task.first.second, less);
+        });
+        runs = merged;
+    }
+}
+
+/**
+ * parallelRadixSort - stable LSD radix sort of (@keys, @values) pairs by
+ * the unsigned 64-bit key, 8 bits per pass. Passes on bytes that are the
+ * same in every key are skipped, so small sizes or close dates take only
+ * a few passes. Each pass counts and scatters per chunk on the global
+ * thread pool; chunk offsets keep the scatter stable.
+ * @keys: sort keys, sorted on return
+ * @values: payload moved with its key, usually the row
+ */
+template <typename V>
+void parallelRadixSort(QList<quint64>& keys, QList<V>& values)
+{
+    const qsizetype n = keys.size();
+    if (n < 2)
+    {
+        return;
+    }
+    const qsizetype chunks = qMax<qsizetype>(1, qMin<qsizetype>(QThread::idealThreadCount(), n / PARALLEL_SORT_MIN_CHUNK));
+    QList<int> chunkIds;
+    for (int i = 0; i < chunks; ++i)
+    {
+        chunkIds.append(i);
+    }
+    auto chunkBegin = [n, chunks](qsizetype chunk) { return n * chunk / chunks; };
+
+    quint64 diff = 0;
+    for (qsizetype i = 1; i < n; ++i)
+    {
+        diff |= keys.at(i) ^ keys.at(0);
+    }
+
+    QList<quint64> keyBuffer(n);
+    QList<V> valueBuffer(n);
+    QList<std::array<qsizetype, 256>> offsets(chunks);
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        if (((diff >> shift) & 0xFF) == 0)
+        {
+            continue;
+        }
+        const quint64* srcKeys = keys.constData();
+        const V* srcValues = values.constData();
+        quint64* dstKeys = keyBuffer.data();
+        V* dstValues = valueBuffer.data();
+        std::array<qsizetype, 256>* chunkOffsets = offsets.data();
+
+        // 各块统计本块的桶大小
+        QtConcurrent::blockingMap(chunkIds, [=](int chunk) {
+            std::array<qsizetype, 256>& count = chunkOffsets[chunk];
+            count.fill(0);
+            for (qsizetype i = chunkBegin(chunk); i < chunkBegin(chunk + 1); ++i)
+            {
+                ++count[(srcKeys[i] >> shift) & 0xFF];
+            }
+        });
+        // 桶 d 中块 c 的起点 = 更小的桶总数 + 桶 d 中前面块的数量
+        qsizetype position = 0;
+        for (int digit = 0; digit < 256; ++digit)
+        {
+            for (qsizetype chunk = 0; chunk < chunks; ++chunk)
+            {
+                const qsizetype count = chunkOffsets[chunk][digit];
+                chunkOffsets[chunk][digit] = position;
+                position += count;
+            }
+        }
+        QtConcurrent::blockingMap(chunkIds, [=](int chunk) {
+            std::array<qsizetype, 256>& offset = chunkOffsets[chunk];
+            for (qsizetype i = chunkBegin(chunk); i < chunkBegin(chunk + 1); ++i)
+            {
+                const qsizetype to = offset[(srcKeys[i] >> shift) & 0xFF]++;
+                dstKeys[to] = srcKeys[i];
+                dstValues[to] = srcValues[i];
+            }
+        });
+        keys.swap(keyBuffer);
+        values.swap(valueBuffer);
+    }
+}
+
+#endif
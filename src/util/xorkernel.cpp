@@ -0,0 +1,188 @@
+#include "xorkernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define XOR_KERNEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define XOR_KERNEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define XOR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define XOR_TARGET_AVX2
+#endif
+
+typedef void (*XorFunc)(uint8_t*, const uint8_t*, size_t, uint8_t);
+
+void xorBufferScalar(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        dst[i] = src[i] ^ key;
+    }
+}
+
+#ifdef XOR_KERNEL_X86
+static void xorBufferSse2(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key)
+{
+    const __m128i k = _mm_set1_epi8(static_cast<char>(key));
+    size_t i = 0;
+    // 每次处理64字节, 非对齐读写, mmap的源地址与QByteArray的目标地址对齐不一致
+    for (; i + 64 <= len; i += 64)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(a, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 16), _mm_xor_si128(b, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 32), _mm_xor_si128(c, k));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 48), _mm_xor_si128(d, k));
+    }
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(a, k));
+    }
+    xorBufferScalar(dst + i, src + i, len - i, key);
+}
+
+XOR_TARGET_AVX2 static void xorBufferAvx2(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key)
+{
+    const __m256i k = _mm256_set1_epi8(static_cast<char>(key));
+    size_t i = 0;
+    for (; i + 128 <= len; i += 128)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 96));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), _mm256_xor_si256(b, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 64), _mm256_xor_si256(c, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 96), _mm256_xor_si256(d, k));
+    }
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, k));
+    }
+    xorBufferScalar(dst + i, src + i, len - i, key);
+}
+
+static bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4] = { 0 };
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // OSXSAVE + AVX, 且操作系统保存了ymm寄存器
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef XOR_KERNEL_NEON
+static void xorBufferNeon(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key)
+{
+    const uint8x16_t k = vdupq_n_u8(key);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        uint8x16_t a = vld1q_u8(src + i);
+        uint8x16_t b = vld1q_u8(src + i + 16);
+        uint8x16_t c = vld1q_u8(src + i + 32);
+        uint8x16_t d = vld1q_u8(src + i + 48);
+        vst1q_u8(dst + i, veorq_u8(a, k));
+        vst1q_u8(dst + i + 16, veorq_u8(b, k));
+        vst1q_u8(dst + i + 32, veorq_u8(c, k));
+        vst1q_u8(dst + i + 48, veorq_u8(d, k));
+    }
+    for (; i + 16 <= len; i += 16)
+    {
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), k));
+    }
+    xorBufferScalar(dst + i, src + i, len - i, key);
+}
+#endif
+
+struct XorKernel
+{
+    XorFunc func;
+    const char* name;
+};
+
+#define XOR_KERNEL_MAX 4
+
+struct XorKernelList
+{
+    XorKernel kernels[XOR_KERNEL_MAX];
+    size_t count;
+};
+
+// cpu支持的路径, 最宽的在前, 最后是标量
+static XorKernelList detectXorKernels()
+{
+    XorKernelList list = {};
+#if defined(XOR_KERNEL_X86)
+    if (cpuHasAvx2())
+        list.kernels[list.count++] = { xorBufferAvx2, "avx2" };
+    list.kernels[list.count++] = { xorBufferSse2, "sse2" };
+#elif defined(XOR_KERNEL_NEON)
+    list.kernels[list.count++] = { xorBufferNeon, "neon" };
+#endif
+    list.kernels[list.count++] = { xorBufferScalar, "scalar" };
+    return list;
+}
+
+// 首次调用时检测cpu, c++11起局部静态变量初始化线程安全
+static const XorKernelList& xorKernels()
+{
+    static const XorKernelList list = detectXorKernels();
+    return list;
+}
+
+static const XorKernel& xorKernel()
+{
+    return xorKernels().kernels[0];
+}
+
+void xorBuffer(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key)
+{
+    xorKernel().func(dst, src, len, key);
+}
+
+const char* xorKernelName()
+{
+    return xorKernel().name;
+}
+
+size_t xorKernelCount()
+{
+    return xorKernels().count;
+}
+
+const char* xorKernelNameAt(size_t index)
+{
+    return index < xorKernels().count ? xorKernels().kernels[index].name : "";
+}
+
+void xorBufferWith(size_t index, uint8_t* dst, const uint8_t* src, size_t len, uint8_t key)
+{
+    xorKernels().kernels[index < xorKernels().count ? index : xorKernels().count - 1].func(dst, src, len, key);
+}
@@ -0,0 +1,43 @@
+#ifndef _XORKERNEL_H
+#define _XORKERNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * xorBuffer - dst[i] = src[i] ^ key, dispatched to the widest SIMD path
+ * the running cpu supports (AVX2 / SSE2 / NEON). dst may equal src.
+ * @dst: output buffer
+ * @src: input buffer
+ * @len: data size
+ * @key: xor byte
+ */
+void xorBuffer(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key);
+
+/**
+ * xorBufferScalar - byte-at-a-time reference implementation of xorBuffer
+ */
+void xorBufferScalar(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key);
+
+/**
+ * xorKernelName - name of the path selected by xorBuffer, for logging
+ */
+const char* xorKernelName();
+
+/**
+ * xorKernelCount - number of paths the running cpu supports, widest first,
+ * the last one is always the scalar path. Used by tests to cover every path.
+ */
+size_t xorKernelCount();
+
+/**
+ * xorKernelNameAt - name of path @index, 0 <= @index < xorKernelCount()
+ */
+const char* xorKernelNameAt(size_t index);
+
+/**
+ * xorBufferWith - xorBuffer through path @index instead of the selected one
+ */
+void xorBufferWith(size_t index, uint8_t* dst, const uint8_t* src, size_t len, uint8_t key);
+
+#endif
@@ -0,0 +1,81 @@
+// xorBuffer 各个SIMD路径与标量结果比较: 长度 0..MAX_LEN, 源/目标偏移 0..31, 以及原地异或
+#include "../src/util/xorkernel.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define MAX_LEN 1024
+#define MAX_OFFSET 32
+
+static void reference(uint8_t* dst, const uint8_t* src, size_t len, uint8_t key)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        dst[i] = src[i] ^ key;
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(20240501);
+    // 前后各留一段哨兵, 检查越界写入
+    const size_t guard = 64;
+    const size_t size = guard + MAX_OFFSET + MAX_LEN + guard;
+    std::vector<uint8_t> src(size);
+    std::vector<uint8_t> dst(size);
+    std::vector<uint8_t> expected(size);
+    for (auto& b : src)
+    {
+        b = static_cast<uint8_t>(rng());
+    }
+
+    int failures = 0;
+    // 下标 count 表示通过 xorBuffer 分发
+    const size_t count = xorKernelCount();
+    for (size_t kernel = 0; kernel <= count; ++kernel)
+    {
+        const char* name = kernel < count ? xorKernelNameAt(kernel) : xorKernelName();
+        int kernelFailures = 0;
+        for (size_t len = 0; len <= MAX_LEN; ++len)
+        {
+            const uint8_t key = static_cast<uint8_t>(rng());
+            for (size_t srcOffset = 0; srcOffset < MAX_OFFSET; ++srcOffset)
+            {
+                for (size_t dstOffset = 0; dstOffset < MAX_OFFSET; ++dstOffset)
+                {
+                    std::memset(dst.data(), 0xA5, size);
+                    std::memset(expected.data(), 0xA5, size);
+                    const uint8_t* s = src.data() + guard + srcOffset;
+                    reference(expected.data() + guard + dstOffset, s, len, key);
+                    if (kernel < count)
+                        xorBufferWith(kernel, dst.data() + guard + dstOffset, s, len, key);
+                    else
+                        xorBuffer(dst.data() + guard + dstOffset, s, len, key);
+                    if (dst != expected)
+                    {
+                        ++kernelFailures;
+                    }
+                }
+
+                // 原地
+                std::vector<uint8_t> inPlace(src);
+                std::vector<uint8_t> inPlaceExpected(src);
+                uint8_t* p = inPlace.data() + guard + srcOffset;
+                reference(inPlaceExpected.data() + guard + srcOffset, inPlaceExpected.data() + guard + srcOffset, len, key);
+                if (kernel < count)
+                    xorBufferWith(kernel, p, p, len, key);
+                else
+                    xorBuffer(p, p, len, key);
+                if (inPlace != inPlaceExpected)
+                {
+                    ++kernelFailures;
+                }
+            }
+        }
+        std::printf("%s%s: %d failures\n", name, kernel < count ? "" : " (dispatched)", kernelFailures);
+        failures += kernelFailures;
+    }
+    return failures == 0 ? 0 : 1;
+}